@@ -0,0 +1,86 @@
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "alloc.hpp"
+
+// The global operator new and delete that count for alloc::Scope. Linked
+// into a program only with the alloc_tracking option, which also defines
+// NOGO_ALLOC_TRACKING.
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    if (!alloc::paused) {
+        alloc::counters.count++;
+        alloc::counters.bytes += size;
+    }
+    return std::malloc(size ? size : 1);
+}
+void* operator new(std::size_t size)
+{
+    if (auto p = operator new(size, std::nothrow))
+        return p;
+    throw std::bad_alloc {};
+}
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+// std::pmr::new_delete_resource allocates through the aligned forms
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    if (!alloc::paused) {
+        alloc::counters.count++;
+        alloc::counters.bytes += size;
+    }
+    auto alignment { static_cast<std::size_t>(align) };
+    // aligned_alloc wants a size that is a non-zero multiple of the alignment
+    auto rounded { std::max((size + alignment - 1) / alignment * alignment, alignment) };
+    if (auto p = std::aligned_alloc(alignment, rounded))
+        return p;
+    throw std::bad_alloc {};
+}
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return operator new(size, align);
+}
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <cstdint>
+#include <string>
+
+#include "log.hpp"
+#include "metrics.hpp"
+
+// Allocation accounting, compiled in with NOGO_ALLOC_TRACKING. The global
+// operator new counts into thread-local counters, and an `alloc::Scope`
+// attributes what its thread allocated while it was alive to a subsystem,
+// published as `alloc.<name>.{events,count,bytes}` metrics; nested scopes are
+// included in the enclosing one. The replacement operator new is defined in
+// alloc.cpp, which the build links in with the alloc_tracking option.
+namespace alloc {
+
+struct Counters {
+    std::uint64_t count {}, bytes {};
+};
+
+#ifdef NOGO_ALLOC_TRACKING
+inline thread_local Counters counters;
+// set while a scope reports, so the report is not charged to enclosing scopes
+inline thread_local bool paused {};
+#endif
+
+_EXPORT class Scope {
+public:
+    // `arg` tells events of one name apart, e.g. the opcode of a handler
+    explicit Scope([[maybe_unused]] const char* name, [[maybe_unused]] std::int64_t arg = -1)
+#ifdef NOGO_ALLOC_TRACKING
+        : name_ { name }
+        , arg_ { arg }
+        , start_ { counters }
+#endif
+    {
+    }
+    Scope(const Scope&) = delete;
+    ~Scope()
+    {
+#ifdef NOGO_ALLOC_TRACKING
+        auto count { counters.count - start_.count };
+        auto bytes { counters.bytes - start_.bytes };
+        paused = true;
+        std::string prefix { "alloc." };
+        prefix += name_;
+        if (arg_ >= 0)
+            prefix += "." + std::to_string(arg_);
+        metrics.add(prefix + ".events", 1);
+        metrics.add(prefix + ".count", count);
+        metrics.add(prefix + ".bytes", bytes);
+        if (logger)
+            logger->trace("{} made {} allocations of {} bytes", prefix, count, bytes);
+        paused = false;
+#endif
+    }
+
+private:
+#ifdef NOGO_ALLOC_TRACKING
+    const char* name_;
+    std::int64_t arg_;
+    Counters start_;
+#endif
+};
+
+}
+
+#define ALLOC_CONCAT_IMPL(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_IMPL(a, b)
+#ifdef NOGO_ALLOC_TRACKING
+#define ALLOC_SCOPE(...) alloc::Scope ALLOC_CONCAT(alloc_scope_, __LINE__) { __VA_ARGS__ }
+#else
+#define ALLOC_SCOPE(...)
+#endif
@@ -0,0 +1,115 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <set>
+#include <string>
+#include <tuple>
+
+#include "contest.hpp"
+
+using nlohmann::json;
+
+_EXPORT struct GameRecord {
+    std::uint64_t id;
+    std::string black, white;
+    int winner;
+    Contest::WinType win_type;
+    // the moves in order, as Contest::encode() writes them for the frontend:
+    // a packed position would keep the last board but not how it was played
+    std::string moves;
+    long long start_time, end_time;
+
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE(GameRecord, id, black, white, winner, win_type, moves, start_time, end_time)
+};
+
+_EXPORT struct Standing {
+    std::string name;
+    int wins {}, losses {};
+
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE(Standing, name, wins, losses)
+};
+
+// In-memory index of finished games and the leaderboard built from them.
+// `version()` changes on every update so readers can cache what they render.
+// It lives on the thread of the HTTP API, where the room posts its records.
+_EXPORT class GameArchive {
+public:
+    enum { max_records = 10000 };
+
+    // the record of a finished game, numbered when it is added
+    static auto make_record(const Contest& contest) -> GameRecord
+    {
+        auto to_ms = [](auto tp) { return std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count(); };
+        return { 0, contest.players.at(Role::BLACK).name, contest.players.at(Role::WHITE).name, contest.result.winner.id,
+            contest.result.win_type, contest.encode(), to_ms(contest.start_time), to_ms(contest.end_time) };
+    }
+
+    void add(GameRecord record)
+    {
+        record.id = next_id_++;
+        if (record.winner) {
+            auto black_won { record.winner == Role::BLACK.id };
+            update_standing(black_won ? record.black : record.white, 1, 0);
+            update_standing(black_won ? record.white : record.black, 0, 1);
+        }
+        records_.push_back(std::move(record));
+        if (records_.size() > max_records)
+            records_.pop_front();
+        version_++;
+    }
+
+    auto version() const { return version_; }
+
+    auto record(std::uint64_t id) const -> std::optional<GameRecord>
+    {
+        if (records_.empty() || id < records_.front().id || id > records_.back().id)
+            return std::nullopt;
+        return records_[id - records_.front().id];
+    }
+
+    // most recent games first
+    auto games(std::size_t page, std::size_t page_size) const
+    {
+        json res = json::array();
+        for (auto i = page * page_size; i < (page + 1) * page_size && i < records_.size(); i++)
+            res.push_back(records_[records_.size() - 1 - i]);
+        return res;
+    }
+
+    auto leaderboard(std::size_t page, std::size_t page_size) const
+    {
+        json res = json::array();
+        auto it = ranking_.begin();
+        for (std::size_t i = 0; i < page * page_size && it != ranking_.end(); i++)
+            ++it;
+        for (std::size_t i = 0; i < page_size && it != ranking_.end(); i++, ++it)
+            res.push_back(standings_.at(std::get<2>(*it)));
+        return res;
+    }
+
+private:
+    void update_standing(const std::string& name, int wins, int losses)
+    {
+        auto& standing { standings_[name] };
+        ranking_.erase({ -standing.wins, standing.losses, name });
+        standing.name = name;
+        standing.wins += wins;
+        standing.losses += losses;
+        ranking_.insert({ -standing.wins, standing.losses, name });
+    }
+
+    std::deque<GameRecord> records_;
+    std::map<std::string, Standing> standings_;
+    // ordered by wins descending, then losses ascending
+    std::set<std::tuple<int, int, std::string>> ranking_;
+    std::uint64_t next_id_ { 1 };
+    std::uint64_t version_ {};
+};
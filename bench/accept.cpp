@@ -0,0 +1,79 @@
+// Accept-rate benchmark: clients connect to a listener and disconnect as fast
+// as they can, once with sessions from a ConnectionPool and once without.
+// Built with the alloc_tracking option it also reports how many heap
+// allocations the server thread made per connection.
+//
+//   nogo-bench-accept [connections] [clients]
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asio/use_future.hpp>
+
+#include "../log.hpp"
+#include "../server.hpp"
+
+struct Result {
+    double rate, allocations;
+};
+
+auto run(bool pooled, int connections, int clients) -> Result
+{
+    ConnectionPool pool;
+    asio::io_context io_context(1);
+    Room room { io_context };
+    tcp::acceptor acceptor { io_context, { asio::ip::address_v4::loopback(), 0 } };
+    auto port { acceptor.local_endpoint().port() };
+    co_spawn(io_context, listener(acceptor, room, false, pooled ? &pool : nullptr), detached);
+    std::jthread server { [&] { io_context.run(); } };
+
+    auto start { std::chrono::steady_clock::now() };
+    {
+        std::vector<std::jthread> threads;
+        for (int i = 0; i < clients; i++)
+            threads.emplace_back([&, i] {
+                asio::io_context client_context;
+                for (int j = i; j < connections; j += clients) {
+                    tcp::socket socket { client_context };
+                    socket.connect({ asio::ip::address_v4::loopback(), port });
+                    // reset instead of closing, so no port is left in TIME_WAIT
+                    socket.set_option(asio::socket_base::linger { true, 0 });
+                    socket.close();
+                }
+            });
+    }
+    // the listener may still be behind the clients: wait until every session
+    // has joined and left the room
+    auto version = [&] { return asio::post(io_context, asio::use_future([&] { return room.version(); })).get(); };
+    auto allocations = [&] {
+#ifdef NOGO_ALLOC_TRACKING
+        return asio::post(io_context, asio::use_future([] { return alloc::counters.count; })).get();
+#else
+        return std::uint64_t {};
+#endif
+    };
+    auto start_allocations { allocations() };
+    while (version() < 2 * static_cast<std::uint64_t>(connections))
+        std::this_thread::sleep_for(1ms);
+    std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+    double per_connection { static_cast<double>(allocations() - start_allocations) / connections };
+    io_context.stop();
+    return { connections / elapsed.count(), per_connection };
+}
+
+auto main(int argc, char* argv[]) -> int
+{
+    logger = spdlog::logger("bench");
+    logger->set_level(spdlog::level::off);
+    int connections { argc > 1 ? std::stoi(argv[1]) : 20000 };
+    int clients { argc > 2 ? std::stoi(argv[2]) : 4 };
+
+    // warm up the kernel's ephemeral ports and the allocator before measuring
+    run(false, connections / 10, clients);
+    for (bool pooled : { false, true }) {
+        auto [rate, allocations] { run(pooled, connections, clients) };
+        std::printf("%-12s %10.0f connections/s %8.1f allocations/connection\n", pooled ? "pooled" : "make_shared", rate, allocations);
+    }
+}
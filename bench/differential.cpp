@@ -0,0 +1,268 @@
+// Differential test of rules engines: every engine is asked the same
+// questions about the same positions as the reference, Board::is_capturing
+// and State::available_actions, and any answer that differs is printed with
+// the position. The positions are random playouts, boards filled at random
+// with no regard for the rules, finished games and long chains in atari,
+// each under a random symmetry. The time each engine took is reported next
+// to the reference's.
+//
+//   nogo-differential [positions] [threads] [seed]
+//
+// A new engine only needs an entry in `engines`.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../rule.hpp"
+
+// what an engine answers about a position
+struct Outcome {
+    // the moves of black and of white
+    std::array<Bitboard, 2> legal;
+    // the stones that would have ended the game, had they just been played
+    Bitboard capturing;
+    Role over;
+
+    bool operator==(const Outcome&) const = default;
+};
+
+struct Engine {
+    const char* name;
+    auto (*legal)(const Board&, Role) -> Bitboard;
+    bool (*capturing)(const Board&, Point);
+    auto (*is_over)(const State&) -> Role;
+};
+
+// is_capturing with one flood per group next to `p`
+bool capturing(const Board& board, Point p)
+{
+    auto empty { board.empty() };
+    auto breathes = [&](Point stone) {
+        Bitboard group;
+        group.set(stone);
+        return static_cast<bool>(group.flood(board.stones(board[stone])).neighbors() & empty);
+    };
+    return !breathes(p) || std::ranges::any_of(point_table.neighbors[p.index], [&](Point n) { return board[n] == -board[p] && !breathes(n); });
+}
+
+const std::vector<Engine> engines {
+    {
+        "reference",
+        [](const Board& board, Role role) {
+            Bitboard res;
+            for (auto p : State { board, role, Point {} }.available_actions())
+                res.set(p);
+            return res;
+        },
+        [](const Board& board, Point p) { return board.is_capturing(p); },
+        [](const State& state) { return state.is_over(); },
+    },
+    {
+        "bitboard",
+        [](const Board& board, Role role) { return board.legal(role); },
+        [](const Board& board, Point p) { return capturing(board, p); },
+        [](const State& state) { return state.last_move && capturing(state.board, state.last_move) ? state.role : Role::NONE; },
+    },
+};
+
+constexpr std::array questions { "legal", "capturing", "is_over" };
+using Timings = std::array<std::atomic<long long>, questions.size()>;
+
+// the answers of `engine` about `states`, one question at a time over all of
+// them, so that each is timed on its own and not with the generator
+void answer(const Engine& engine, const std::vector<State>& states, std::vector<Outcome>& outcomes, Timings& nanoseconds)
+{
+    outcomes.assign(states.size(), {});
+    auto timed = [&](std::size_t question, auto&& ask) {
+        auto begin { std::chrono::steady_clock::now() };
+        for (std::size_t i = 0; i < states.size(); i++)
+            ask(states[i], outcomes[i]);
+        nanoseconds[question] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    };
+    timed(0, [&](const State& state, Outcome& outcome) {
+        outcome.legal = { engine.legal(state.board, Role::BLACK), engine.legal(state.board, Role::WHITE) };
+    });
+    timed(1, [&](const State& state, Outcome& outcome) {
+        for (auto p : Board::index())
+            if (state.board[p] && engine.capturing(state.board, p))
+                outcome.capturing.set(p);
+    });
+    timed(2, [&](const State& state, Outcome& outcome) { outcome.over = engine.is_over(state); });
+}
+
+class Generator {
+public:
+    explicit Generator(std::uint64_t seed)
+        : random_ { seed }
+    {
+    }
+
+    auto operator()() -> State
+    {
+        State res;
+        switch (below(4)) {
+        case 0:
+            res = playout(below(rank_n * rank_n));
+            break;
+        case 1:
+            res = filled();
+            break;
+        case 2:
+            res = playout(rank_n * rank_n);
+            break;
+        default:
+            res = chains();
+        }
+        auto k { below(8) };
+        return { res.board.transformed(k), res.role, res.last_move ? point_table.symmetry[k][res.last_move.index] : Point {} };
+    }
+
+private:
+    auto below(int n) -> int { return std::uniform_int_distribution { 0, n - 1 }(random_); }
+    auto pick(const MoveList& moves) { return moves[below(static_cast<int>(moves.size()))]; }
+
+    // up to `length` random legal moves, or until the side to move has none;
+    // now and then the last move is one that ends the game
+    auto playout(int length) -> State
+    {
+        State res;
+        for (int i = 0; i < length; i++) {
+            auto moves { res.available_actions() };
+            if (moves.empty())
+                break;
+            res = res.next_state(pick(moves));
+        }
+        if (below(4) == 0) {
+            MoveList empty;
+            for (auto p : Board::index())
+                if (!res.board[p])
+                    empty.push_back(p);
+            if (!empty.empty())
+                res = res.next_state(pick(empty));
+        }
+        return res;
+    }
+
+    // stones anywhere, groups without liberties included
+    auto filled() -> State
+    {
+        State res { below(2) ? Role::BLACK : Role::WHITE };
+        auto density { below(100) };
+        for (auto p : Board::index())
+            if (below(100) < density)
+                res.board[p] = below(2) ? Role::BLACK : Role::WHITE;
+        // half of them with a last move, by the side not to move
+        if (auto stones = res.board.stones(-res.role); stones && below(2)) {
+            for (int skip = below(stones.count()); skip--;)
+                stones.reset(stones.first());
+            res.last_move = stones.first();
+        }
+        return res;
+    }
+
+    // random walks of stones, which leave long groups with few liberties
+    auto chains() -> State
+    {
+        State res { below(2) ? Role::BLACK : Role::WHITE };
+        for (int n = 1 + below(6); n--;) {
+            auto role { below(2) ? Role::BLACK : Role::WHITE };
+            auto p { Point { below(rank_n * rank_n) } };
+            for (int length = below(3 * rank_n); length--;) {
+                if (!res.board[p])
+                    res.board[p] = role;
+                auto& neighbors { point_table.neighbors[p.index] };
+                p = neighbors.points[below(neighbors.size)];
+            }
+        }
+        for (auto p : Board::index())
+            if (!res.board[p] && below(8) == 0)
+                res.board[p] = below(2) ? Role::BLACK : Role::WHITE;
+        if (auto stones = res.board.stones(-res.role))
+            res.last_move = stones.first();
+        return res;
+    }
+
+    std::mt19937_64 random_;
+};
+
+auto describe(const State& state, const Outcome& expected, const Outcome& got) -> std::string
+{
+    std::ostringstream os;
+    os << state.board << "to move: " << state.role.to_string() << ", last move: " << (state.last_move ? state.last_move.to_string() : "none") << '\n';
+    auto points = [&](Bitboard set) {
+        std::string res;
+        for (; set; set.reset(set.first()))
+            res += " " + set.first().to_string();
+        return res.empty() ? std::string { " none" } : res;
+    };
+    for (int i = 0; i < 2; i++)
+        if (expected.legal[i] != got.legal[i])
+            os << (i ? "white" : "black") << " moves only in the reference:" << points(expected.legal[i] & ~got.legal[i])
+               << ", only here:" << points(got.legal[i] & ~expected.legal[i]) << '\n';
+    if (expected.capturing != got.capturing)
+        os << "capturing stones only in the reference:" << points(expected.capturing & ~got.capturing)
+           << ", only here:" << points(got.capturing & ~expected.capturing) << '\n';
+    if (expected.over != got.over)
+        os << "is_over: " << expected.over.to_string() << " in the reference, " << got.over.to_string() << " here\n";
+    return os.str();
+}
+
+auto main(int argc, char* argv[]) -> int
+{
+    long long positions { argc > 1 ? std::stoll(argv[1]) : 1'000'000 };
+    int threads { argc > 2 ? std::stoi(argv[2]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency())) };
+    std::uint64_t seed { argc > 3 ? std::stoull(argv[3]) : std::random_device {}() };
+    constexpr long long batch { 4096 };
+    constexpr int shown { 5 };
+
+    std::vector<Timings> nanoseconds(engines.size());
+    std::vector<std::atomic<long long>> mismatches(engines.size());
+    std::atomic<long long> next { 0 };
+    std::mutex output;
+    {
+        std::vector<std::jthread> workers;
+        for (int i = 0; i < threads; i++)
+            workers.emplace_back([&, i] {
+                Generator generate { seed + i };
+                std::vector<State> states;
+                std::vector<std::vector<Outcome>> outcomes(engines.size());
+                for (long long start; (start = next.fetch_add(batch)) < positions;) {
+                    states.clear();
+                    for (auto n { std::min(batch, positions - start) }; n--;)
+                        states.push_back(generate());
+                    for (std::size_t e = 0; e < engines.size(); e++)
+                        answer(engines[e], states, outcomes[e], nanoseconds[e]);
+                    for (std::size_t e = 1; e < engines.size(); e++)
+                        for (std::size_t j = 0; j < states.size(); j++)
+                            if (outcomes[e][j] != outcomes[0][j] && mismatches[e]++ < shown) {
+                                std::lock_guard lock { output };
+                                std::printf("%s disagrees with the reference:\n%s\n", engines[e].name, describe(states[j], outcomes[0][j], outcomes[e][j]).c_str());
+                            }
+                }
+            });
+    }
+
+    std::printf("%lld positions on %d threads, seed %llu, in ns per position and against the reference\n", positions, threads,
+        static_cast<unsigned long long>(seed));
+    std::printf("%-12s", "");
+    for (auto question : questions)
+        std::printf(" %18s", question);
+    std::printf(" %12s\n", "mismatches");
+    bool agreed { true };
+    for (std::size_t e = 0; e < engines.size(); e++) {
+        std::printf("%-12s", engines[e].name);
+        for (std::size_t q = 0; q < questions.size(); q++)
+            std::printf(" %9.0f %7.2fx", static_cast<double>(nanoseconds[e][q]) / positions,
+                static_cast<double>(nanoseconds[0][q]) / std::max(1LL, nanoseconds[e][q].load()));
+        std::printf(" %12lld\n", mismatches[e].load());
+        agreed = agreed && !mismatches[e];
+    }
+    return agreed ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+// Embedded server benchmark: how long a Server takes to start and stop with
+// no listeners, and the round trip of chat between two connections within
+// the process, one message at a time and then pipelined.
+//
+//   nogo-bench-embed [messages]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../log.hpp"
+#include "../server.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+auto microseconds(Clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); }
+
+auto main(int argc, char* argv[]) -> int
+{
+    logger = spdlog::logger("bench");
+    logger->set_level(spdlog::level::off);
+    int messages { argc > 1 ? std::stoi(argv[1]) : 100000 };
+
+    std::vector<double> starts, stops;
+    for (int i = 0; i < 100; i++) {
+        auto begin { Clock::now() };
+        std::optional<Server> server { std::in_place };
+        server->start();
+        auto started { Clock::now() };
+        server.reset();
+        starts.push_back(microseconds(started - begin));
+        stops.push_back(microseconds(Clock::now() - started));
+    }
+    std::ranges::sort(starts), std::ranges::sort(stops);
+    std::printf("start %8.1f us, stop %8.1f us (median of %zu)\n", starts[starts.size() / 2], stops[stops.size() / 2], starts.size());
+
+    Server server;
+    server.start();
+    auto local { server.connect(true) }, remote { server.connect(false) };
+    auto receive_chat = [&] {
+        for (;;) {
+            auto msg { local->receive(1s) };
+            if (!msg)
+                throw std::runtime_error("no reply");
+            if (msg->op == OpCode::CHAT_RECEIVE_MESSAGE_OP)
+                return;
+        }
+    };
+
+    std::vector<double> round_trips;
+    for (int i = 0; i < messages; i++) {
+        auto begin { Clock::now() };
+        remote->send({ OpCode::CHAT_OP, "ping" });
+        receive_chat();
+        round_trips.push_back(microseconds(Clock::now() - begin));
+    }
+    std::ranges::sort(round_trips);
+    std::printf("round trip p50 %6.1f us, p99 %6.1f us over %d messages\n", round_trips[round_trips.size() / 2], round_trips[round_trips.size() * 99 / 100], messages);
+
+    auto begin { Clock::now() };
+    for (int i = 0; i < messages; i++)
+        remote->send({ OpCode::CHAT_OP, "ping" });
+    for (int i = 0; i < messages; i++)
+        receive_chat();
+    std::chrono::duration<double> elapsed { Clock::now() - begin };
+    std::printf("pipelined %10.0f messages/s\n", messages / elapsed.count());
+}
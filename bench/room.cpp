@@ -0,0 +1,302 @@
+// Room benchmark without sockets: scripted games, a chat storm and a queue of
+// requests are fed to Room::process_data by mock participants, which only
+// count what they are delivered. It reports the events handled per second, and the latency of
+// each opcode. Games left to run out of time are played on a virtual clock,
+// and checked to end on the nanosecond.
+//
+//   nogo-bench-room [games] [chat messages]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../log.hpp"
+#include "../server.hpp"
+
+class MockParticipant : public Participant {
+public:
+    MockParticipant(bool is_local, std::string name, tcp::endpoint endpoint)
+        : Participant(is_local)
+        , name_ { std::move(name) }
+        , endpoint_ { endpoint }
+    {
+    }
+
+    std::string_view get_name() const override { return name_; }
+    void set_name(std::string_view name) override { name_ = name; }
+    tcp::endpoint endpoint() const override { return endpoint_; }
+    void deliver(Message msg) override { delivered[msg.op]++; }
+    void stop() override { }
+    bool operator==(const Participant& participant) const override { return this == &participant; }
+
+    std::map<OpCode, long long> delivered;
+
+private:
+    std::string name_;
+    tcp::endpoint endpoint_;
+};
+
+// feeds a fresh room and times every message it handles
+class Driver {
+public:
+    explicit Driver(bool virtual_time = false)
+        : clock_ { virtual_time ? std::make_unique<timing::VirtualClock>(io_context_) : nullptr }
+        , room_ { io_context_, clock_.get() }
+    {
+    }
+
+    void advance(timing::Clock::duration d) { clock_->advance(d); }
+    // a failed expectation of a script
+    void fail() { errors_++; }
+
+    auto participant(bool is_local, std::string name) -> std::shared_ptr<MockParticipant>
+    {
+        auto port { static_cast<asio::ip::port_type>(40000 + participants_.size()) };
+        auto res { std::make_shared<MockParticipant>(is_local, std::move(name), tcp::endpoint { asio::ip::address_v4::loopback(), port }) };
+        participants_.push_back(res);
+        room_.join(res);
+        return res;
+    }
+
+    void send(const Participant_ptr& from, Message msg)
+    {
+        auto op { msg.op };
+        auto begin { std::chrono::steady_clock::now() };
+        try {
+            room_.process_data(std::move(msg), from);
+        } catch (std::exception& e) {
+            errors_++;
+        }
+        latencies_[op].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+        // cancelled clocks and lobby updates, outside of the timing
+        if (io_context_.stopped())
+            io_context_.restart();
+        io_context_.poll();
+    }
+
+    void report(const char* name) const
+    {
+        long long events {}, nanoseconds {}, delivered {};
+        for (auto& [op, latencies] : latencies_)
+            for (auto latency : latencies)
+                events++, nanoseconds += latency;
+        for (auto& participant : participants_)
+            for (auto& [op, count] : participant->delivered)
+                delivered += count;
+        std::printf("%s: %lld events, %.0f events/s, %lld messages delivered, %lld errors\n", name, events,
+            events / (nanoseconds / 1e9), delivered, errors_);
+        std::printf("  %-32s %8s %10s %10s %10s %10s\n", "opcode", "count", "mean (us)", "p50 (us)", "p99 (us)", "max (us)");
+        for (auto [op, latencies] : latencies_) {
+            std::ranges::sort(latencies);
+            auto at = [&](double q) { return latencies[static_cast<std::size_t>(q * (latencies.size() - 1))] / 1e3; };
+            double sum {};
+            for (auto latency : latencies)
+                sum += latency;
+            std::printf("  %-32s %8zu %10.2f %10.2f %10.2f %10.2f\n", name_of(op), latencies.size(), sum / latencies.size() / 1e3, at(0.5), at(0.99), at(1));
+        }
+    }
+
+private:
+    static auto name_of(OpCode op) -> const char*
+    {
+        switch (op) {
+        case OpCode::READY_OP:
+            return "READY_OP";
+        case OpCode::MOVE_OP:
+            return "MOVE_OP";
+        case OpCode::SUICIDE_END_OP:
+            return "SUICIDE_END_OP";
+        case OpCode::TIMEOUT_END_OP:
+            return "TIMEOUT_END_OP";
+        case OpCode::CHAT_OP:
+            return "CHAT_OP";
+        case OpCode::START_LOCAL_GAME_OP:
+            return "START_LOCAL_GAME_OP";
+        case OpCode::LOCAL_GAME_MOVE_OP:
+            return "LOCAL_GAME_MOVE_OP";
+        case OpCode::CHAT_SEND_MESSAGE_OP:
+            return "CHAT_SEND_MESSAGE_OP";
+        case OpCode::CHAT_SEND_BROADCAST_MESSAGE_OP:
+            return "CHAT_SEND_BROADCAST_MESSAGE_OP";
+        case OpCode::UPDATE_USERNAME_OP:
+            return "UPDATE_USERNAME_OP";
+        case OpCode::ACCEPT_REQUEST_OP:
+            return "ACCEPT_REQUEST_OP";
+        case OpCode::REJECT_REQUEST_OP:
+            return "REJECT_REQUEST_OP";
+        default:
+            return "other";
+        }
+    }
+
+    asio::io_context io_context_;
+    std::unique_ptr<timing::VirtualClock> clock_;
+    Room room_;
+    std::vector<std::shared_ptr<MockParticipant>> participants_;
+    std::map<OpCode, std::vector<long long>> latencies_;
+    long long errors_ {};
+};
+
+// Random legal moves until the side to move has none, then a move that
+// loses, as the games people play end.
+auto script(std::mt19937_64& random) -> std::vector<Point>
+{
+    std::vector<Point> res;
+    State state;
+    for (auto moves { state.available_actions() }; !moves.empty(); moves = state.available_actions()) {
+        auto move { moves[std::uniform_int_distribution<std::size_t> { 0, moves.size() - 1 }(random)] };
+        res.push_back(move);
+        state = state.next_state(move);
+    }
+    if (auto empty = state.board.empty())
+        res.push_back(empty.first());
+    return res;
+}
+
+// both sides played from the local UI
+void local_games(int games, std::mt19937_64& random)
+{
+    Driver driver;
+    auto local { driver.participant(true, "") };
+    driver.send(local, { OpCode::UPDATE_USERNAME_OP, "alice" });
+    for (int i = 0; i < games; i++) {
+        driver.send(local, { OpCode::START_LOCAL_GAME_OP, "30", "9" });
+        auto role { Role::BLACK };
+        for (auto move : script(random)) {
+            driver.send(local, { OpCode::LOCAL_GAME_MOVE_OP, move.to_string(), role.map("b", "w", "") });
+            role = -role;
+        }
+    }
+    driver.report("local games");
+}
+
+// a remote player asks for a game as black, the local one accepts, and the
+// loser confirms the end
+void online_games(int games, std::mt19937_64& random)
+{
+    Driver driver;
+    auto local { driver.participant(true, "alice") };
+    auto remote { driver.participant(false, "bob") };
+    for (int i = 0; i < games; i++) {
+        driver.send(remote, { OpCode::READY_OP, "bob", "b" });
+        driver.send(local, { OpCode::ACCEPT_REQUEST_OP });
+        auto black { true };
+        for (auto move : script(random)) {
+            driver.send(black ? Participant_ptr { remote } : Participant_ptr { local }, { OpCode::MOVE_OP, move.to_string(), "1000" });
+            black = !black;
+        }
+        driver.send(remote, { OpCode::SUICIDE_END_OP });
+    }
+    driver.report("online games");
+}
+
+// Games where the side to move stops playing, on a virtual clock: nothing
+// happens a nanosecond before the time is up, and the game ends on it. The
+// local ones are against the clock of the game, the online ones against
+// TIMEOUT, and the remote player is told it lost or claims its win.
+void timeouts(int games, std::mt19937_64& random)
+{
+    Driver driver { true };
+    auto local { driver.participant(true, "alice") };
+    auto remote { driver.participant(false, "bob") };
+    constexpr auto local_timeout { 30s };
+    for (int i = 0; i < games; i++) {
+        auto moves { script(random) };
+        // at least one move, which starts the clock, and not the losing one
+        moves.resize(std::uniform_int_distribution<std::size_t> { 1, moves.size() - 1 }(random));
+        auto ended = [&](auto& participant) { return participant->delivered[OpCode::TIMEOUT_END_OP]; };
+        auto before { ended(i % 2 ? remote : local) };
+        if (i % 2 == 0) {
+            driver.send(local, { OpCode::START_LOCAL_GAME_OP, std::to_string(local_timeout.count()), "9" });
+            auto role { Role::BLACK };
+            for (auto move : moves) {
+                driver.send(local, { OpCode::LOCAL_GAME_MOVE_OP, move.to_string(), role.map("b", "w", "") });
+                role = -role;
+            }
+            driver.advance(local_timeout - 1ns);
+            if (ended(local) != before)
+                driver.fail();
+            driver.advance(1ns);
+            if (ended(local) != before + 1)
+                driver.fail();
+        } else {
+            driver.send(remote, { OpCode::READY_OP, "bob", "b" });
+            driver.send(local, { OpCode::ACCEPT_REQUEST_OP });
+            auto black { true };
+            for (auto move : moves) {
+                driver.send(black ? Participant_ptr { remote } : Participant_ptr { local }, { OpCode::MOVE_OP, move.to_string(), "1000" });
+                black = !black;
+            }
+            driver.advance(TIMEOUT - 1ns);
+            if (ended(remote) != before)
+                driver.fail();
+            driver.advance(1ns);
+            // bob to move has lost, or claims the win and is confirmed
+            if (!black)
+                driver.send(remote, { OpCode::TIMEOUT_END_OP });
+            if (ended(remote) != before + 1)
+                driver.fail();
+        }
+    }
+    driver.report("timeouts");
+}
+
+// guests chatting to the local player, who answers everyone and some of them
+// in private
+void chat_storm(int messages)
+{
+    constexpr int guests { 32 };
+    Driver driver;
+    auto local { driver.participant(true, "alice") };
+    std::vector<Participant_ptr> remotes;
+    for (int i = 0; i < guests; i++)
+        remotes.push_back(driver.participant(false, "guest" + std::to_string(i)));
+    for (int i = 0; i < messages; i++) {
+        auto text { "message " + std::to_string(i) };
+        if (i % 4 == 0)
+            driver.send(local, { OpCode::CHAT_SEND_BROADCAST_MESSAGE_OP, text });
+        else if (i % 4 == 1)
+            driver.send(local, { OpCode::CHAT_SEND_MESSAGE_OP, text, "guest" + std::to_string(i % guests) });
+        else
+            driver.send(remotes[i % guests], { OpCode::CHAT_OP, text });
+    }
+    driver.report("chat storm");
+}
+
+// guests asking for a game one after another and chatting while they wait,
+// then turned down in turn: what a message costs must not grow with the queue
+void request_queue(int requests)
+{
+    Driver driver;
+    auto local { driver.participant(true, "alice") };
+    std::vector<Participant_ptr> guests;
+    for (int i = 0; i < requests; i++) {
+        guests.push_back(driver.participant(false, "guest" + std::to_string(i)));
+        driver.send(guests.back(), { OpCode::READY_OP, "guest" + std::to_string(i), "b" });
+    }
+    for (auto& guest : guests)
+        driver.send(guest, { OpCode::CHAT_OP, "waiting" });
+    for (int i = 0; i < requests; i++)
+        driver.send(local, { OpCode::REJECT_REQUEST_OP });
+    driver.report("request queue");
+}
+
+auto main(int argc, char* argv[]) -> int
+{
+    logger = spdlog::logger("bench");
+    logger->set_level(spdlog::level::off);
+    // the room narrates games on stdout
+    std::cout.setstate(std::ios::failbit);
+    int games { argc > 1 ? std::stoi(argv[1]) : 1000 };
+    int messages { argc > 2 ? std::stoi(argv[2]) : 100000 };
+
+    std::mt19937_64 random { 1 };
+    local_games(games, random);
+    online_games(games, random);
+    timeouts(games, random);
+    chat_storm(messages);
+    request_queue(games);
+}
@@ -3,34 +3,176 @@
 #define _EXPORT
 #endif 
 
+#include <array>
 #include <chrono>
 #include <cmath>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <numeric>
+#include <optional>
 #include <random>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "alloc.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
 #include "rule.hpp"
+#include "trace.hpp"
+
+#ifdef NOGO_MCTS_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+#endif
 
 namespace chrono = std::chrono;
 using namespace std::chrono_literals;
+#ifndef __GNUC__
 namespace ranges = std::ranges;
+#endif
 
-std::mt19937 rng(std::random_device {}());
-std::uniform_real_distribution<double> dist(0, 1);
+// every search thread owns its generator
+inline thread_local std::mt19937 rng(std::random_device {}());
+inline thread_local std::uniform_real_distribution<double> dist(0, 1);
 // static -> CE
 
+#ifdef NOGO_MCTS_PROFILE
+// Per-phase cost of the MCTS loop, enabled at compile time with NOGO_MCTS_PROFILE.
+// Counts are cycles (TSC) on x86 and nanoseconds elsewhere.
+struct MCTSProfile {
+    enum Phase { SELECTION,
+        EXPANSION,
+        SIMULATION,
+        BACKUP,
+        PHASE_COUNT };
+    static constexpr std::array phase_names { "selection", "expansion", "simulation", "backup" };
+
+    std::array<std::uint64_t, PHASE_COUNT> cycles {};
+    // depth of the expanded nodes
+    std::array<std::uint64_t, rank_n * rank_n + 1> depth {};
+    std::uint64_t expansions {}, branches {};
+    chrono::nanoseconds elapsed {};
+
+    static auto now() -> std::uint64_t
+    {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        return __rdtsc();
+#else
+        return chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    void merge(const MCTSProfile& profile)
+    {
+        for (int i = 0; i < PHASE_COUNT; i++)
+            cycles[i] += profile.cycles[i];
+        for (std::size_t i = 0; i < depth.size(); i++)
+            depth[i] += profile.depth[i];
+        expansions += profile.expansions;
+        branches += profile.branches;
+        elapsed += profile.elapsed;
+    }
+
+    // as a bot worker sends it back with its move, see botproto.hpp
+    auto save() const -> std::string
+    {
+        std::string data(sizeof(MCTSProfile), '\0');
+        std::memcpy(data.data(), this, sizeof(MCTSProfile));
+        return data;
+    }
+
+    static auto load(std::string_view data) -> std::optional<MCTSProfile>
+    {
+        if (data.size() != sizeof(MCTSProfile))
+            return std::nullopt;
+        MCTSProfile profile;
+        std::memcpy(&profile, data.data(), sizeof(MCTSProfile));
+        return profile;
+    }
+
+    void report() const
+    {
+        if (!expansions)
+            return;
+        auto total = std::accumulate(cycles.begin(), cycles.end(), std::uint64_t {});
+        auto depth_sum = std::uint64_t {};
+        auto max_depth = 0;
+        std::string histogram;
+        for (std::size_t i = 0; i < depth.size(); i++) {
+            if (!depth[i])
+                continue;
+            depth_sum += depth[i] * i;
+            max_depth = i;
+            histogram += " " + std::to_string(i) + ":" + std::to_string(depth[i]);
+        }
+        auto nodes_per_second = expansions / chrono::duration<double>(elapsed).count();
+
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            metrics.set(std::string { "mcts." } + phase_names[i] + "_share", static_cast<double>(cycles[i]) / total);
+            metrics.set(std::string { "mcts." } + phase_names[i] + "_cycles_per_iteration", static_cast<double>(cycles[i]) / expansions);
+        }
+        metrics.set("mcts.nodes_per_second", nodes_per_second);
+        metrics.set("mcts.branching_factor", static_cast<double>(branches) / expansions);
+        metrics.set("mcts.mean_depth", static_cast<double>(depth_sum) / expansions);
+        metrics.set("mcts.max_depth", max_depth);
+        if (logger) {
+            logger->info("mcts profile: {} nodes, {:.0f} nodes/s, branching {:.1f}, depth mean {:.2f} max {}",
+                expansions, nodes_per_second, static_cast<double>(branches) / expansions, static_cast<double>(depth_sum) / expansions, max_depth);
+            for (int i = 0; i < PHASE_COUNT; i++)
+                logger->info("mcts profile: {:<10} {:5.1f}% {:.0f} cycles/iteration", phase_names[i], 100.0 * cycles[i] / total, static_cast<double>(cycles[i]) / expansions);
+            logger->info("mcts profile: depth histogram{}", histogram);
+        }
+    }
+};
+
+// profile of the search running on this thread
+inline thread_local MCTSProfile* mcts_profile {};
+
+class MCTSPhase {
+public:
+    explicit MCTSPhase(MCTSProfile::Phase phase)
+        : phase_ { phase }
+        , start_ { MCTSProfile::now() }
+    {
+    }
+    ~MCTSPhase()
+    {
+        if (mcts_profile)
+            mcts_profile->cycles[phase_] += MCTSProfile::now() - start_;
+    }
+
+private:
+    MCTSProfile::Phase phase_;
+    std::uint64_t start_;
+};
+#define MCTS_PHASE(phase) MCTSPhase mcts_phase_##phase { MCTSProfile::phase }
+#else
+#define MCTS_PHASE(phase)
+#endif
+
 // struct to represent a node in the Monte Carlo Tree
 struct MCTSNode : std::enable_shared_from_this<MCTSNode> {
     using MCTSNode_ptr = std::shared_ptr<MCTSNode>;
 
     State state;
-    std::vector<Position> available_actions;
-    MCTSNode_ptr parent;
+    // back-pointer only, the children own the tree
+    MCTSNode* parent;
     std::vector<MCTSNode_ptr> children;
     int visit { 0 };
     double quality { 0 };
 
-    MCTSNode(const State& state, MCTSNode_ptr parent = nullptr)
+    MCTSNode(const State& state, MCTSNode* parent = nullptr)
         : state(state)
         , parent(parent)
     {
@@ -38,7 +180,7 @@ struct MCTSNode : std::enable_shared_from_this<MCTSNode> {
 
     auto add_child(const State& state)
     {
-        auto child = std::make_shared<MCTSNode>(state, shared_from_this());
+        auto child = std::make_shared<MCTSNode>(state, this);
         children.push_back(child);
         return child;
     }
@@ -54,19 +196,30 @@ struct MCTSNode : std::enable_shared_from_this<MCTSNode> {
     // select the node to expand
     auto tree_policy(double C)
     {
-        // if (!node->available_actions.size())
-        //     node->available_actions = node->state.available_actions();
         auto node { shared_from_this() };
+        [[maybe_unused]] int depth {};
 
-        while (!node->state.is_over() && node->children.size() == node->state.available_actions().size()) {
-            node = node->best_child(C);
+        {
+            MCTS_PHASE(SELECTION);
+            while (!node->state.is_over() && node->children.size() == node->state.available_actions().size()) {
+                node = node->best_child(C);
+                depth++;
+            }
         }
 
+        MCTS_PHASE(EXPANSION);
         State state { node->state };
         if (!state.is_over()) {
             auto actions { state.available_actions() };
             auto action { actions[node->children.size()] };
             node = node->add_child(state.next_state(action));
+#ifdef NOGO_MCTS_PROFILE
+            if (mcts_profile) {
+                mcts_profile->expansions++;
+                mcts_profile->branches += actions.size();
+                mcts_profile->depth[std::min<std::size_t>(depth + 1, mcts_profile->depth.size() - 1)]++;
+            }
+#endif
         }
         return node;
     }
@@ -100,7 +253,7 @@ struct MCTSNode : std::enable_shared_from_this<MCTSNode> {
     // backpropagate the result of the simulation
     void backup(double reward)
     {
-        auto node { shared_from_this() };
+        auto node { this };
 
         while (node) {
             node->visit++;
@@ -111,24 +264,144 @@ struct MCTSNode : std::enable_shared_from_this<MCTSNode> {
     }
 };
 
-_EXPORT Position random_bot_player(const State& state)
+_EXPORT inline Point random_bot_player(const State& state)
 {
     auto actions = state.available_actions();
     return actions[rand() % actions.size()];
 }
 
-_EXPORT constexpr auto mcts_bot_player_generator(double C)
+_EXPORT struct SearchOptions {
+    double C { 0.1 };
+    chrono::milliseconds budget { 990ms };
+    // number of search threads, each of them grows its own tree (root parallelization)
+    unsigned threads { 1 };
+    // pin search thread i to cpus[i % cpus.size()], or to cpu i if cpus is empty
+    bool pin_threads {};
+    std::vector<int> cpus;
+};
+
+// Bind the calling thread to a single cpu. Nodes are allocated by the thread
+// that searches them, so a pinned thread keeps its whole tree on the local NUMA node
+// (first-touch policy) and never migrates across sockets.
+_EXPORT inline bool pin_current_thread(int cpu)
 {
-    return [=](const State& state) {
-        auto start = chrono::high_resolution_clock::now();
-        auto root = std::make_shared<MCTSNode>(state);
-        while (chrono::high_resolution_clock::now() - start < 990ms) {
-            auto expand_node = root->tree_policy(C);
-            double reward = expand_node->default_policy2();
-            expand_node->backup(reward);
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+_EXPORT struct SearchResult {
+    // per root action: total visits and quality
+    std::map<Point, std::pair<int, double>> actions;
+    int playouts {};
+#ifdef NOGO_MCTS_PROFILE
+    MCTSProfile profile;
+#endif
+
+    void merge(const MCTSNode& root)
+    {
+        playouts += root.visit;
+        for (auto& child : root.children) {
+            auto& [visit, quality] = actions[child->state.last_move];
+            visit += child->visit;
+            quality += child->quality;
+        }
+    }
+    void merge(const SearchResult& result)
+    {
+        playouts += result.playouts;
+#ifdef NOGO_MCTS_PROFILE
+        profile.merge(result.profile);
+#endif
+        for (auto& [pos, stat] : result.actions) {
+            actions[pos].first += stat.first;
+            actions[pos].second += stat.second;
+        }
+    }
+    auto best_action() const
+    {
+        return ranges::max_element(actions, std::less {}, [](auto& kv) {
+            return kv.second.second / kv.second.first;
+        })->first;
+    }
+};
+
+inline void mcts_search(const State& state, const SearchOptions& options, SearchResult& result)
+{
+    TRACE_SCOPE("mcts_search");
+    ALLOC_SCOPE("mcts_search");
+#ifdef NOGO_MCTS_PROFILE
+    mcts_profile = &result.profile;
+#endif
+    auto start = chrono::high_resolution_clock::now();
+    auto root = std::make_shared<MCTSNode>(state);
+    while (chrono::high_resolution_clock::now() - start < options.budget) {
+        auto expand_node = root->tree_policy(options.C);
+        double reward;
+        {
+            MCTS_PHASE(SIMULATION);
+            reward = expand_node->default_policy2();
         }
-        return root->best_child(0)->state.last_move;
+        MCTS_PHASE(BACKUP);
+        expand_node->backup(reward);
+    }
+    result.merge(*root);
+#ifdef NOGO_MCTS_PROFILE
+    result.profile.elapsed += chrono::high_resolution_clock::now() - start;
+    mcts_profile = nullptr;
+#endif
+}
+
+_EXPORT inline auto mcts_parallel_search(const State& state, const SearchOptions& options)
+{
+    auto cpu = [&](unsigned i) { return options.cpus.empty() ? i : options.cpus[i % options.cpus.size()]; };
+    SearchResult total;
+    // a pinned search runs on a worker even alone, the caller keeps its affinity
+    if (options.threads <= 1 && !options.pin_threads) {
+        mcts_search(state, options, total);
+#ifdef NOGO_MCTS_PROFILE
+        total.profile.report();
+#endif
+        return total;
+    }
+
+    std::vector<SearchResult> results(std::max(options.threads, 1u));
+    {
+        std::vector<std::jthread> workers;
+        for (unsigned i = 0; i < results.size(); i++) {
+            workers.emplace_back([&, i] {
+                if (options.pin_threads)
+                    pin_current_thread(cpu(i));
+                // the tree is built, read and freed by this thread only
+                mcts_search(state, options, results[i]);
+            });
+        }
+    }
+    for (auto& result : results)
+        total.merge(result);
+#ifdef NOGO_MCTS_PROFILE
+    total.profile.report();
+#endif
+    return total;
+}
+
+_EXPORT inline auto mcts_bot_player_generator(SearchOptions options)
+{
+    return [=](const State& state) {
+        return mcts_parallel_search(state, options).best_action();
     };
 }
 
-_EXPORT constexpr auto mcts_bot_player = mcts_bot_player_generator(0.1);
+_EXPORT inline auto mcts_bot_player_generator(double C)
+{
+    SearchOptions options;
+    options.C = C;
+    return mcts_bot_player_generator(options);
+}
+
+_EXPORT inline const auto mcts_bot_player = mcts_bot_player_generator(0.1);
@@ -0,0 +1,336 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#ifndef _WIN32
+#define NOGO_HAS_BOT_WORKERS
+
+#include <asio/awaitable.hpp>
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/local/connect_pair.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <asio/read.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/use_awaitable.hpp>
+#include <asio/write.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef NOGO_MCTS_PROFILE
+#include "bot.hpp"
+#endif
+#include "botproto.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "rule.hpp"
+
+using asio::awaitable;
+using asio::co_spawn;
+using asio::redirect_error;
+using asio::use_awaitable;
+using namespace std::chrono_literals;
+
+// Pool of nogo-bot-worker processes. Every worker is connected through a unix
+// domain socket pair; queries go to the worker with the fewest outstanding
+// requests, and a worker that dies, or that doesn't answer in time, is reaped
+// and respawned while its pending queries are handed to the others.
+_EXPORT class BotPool {
+public:
+    struct Options {
+        unsigned workers {};
+        std::string worker_path { "./nogo-bot-worker" };
+        unsigned threads { 1 };
+        // pin every search thread to a cpu of its own, handed out in turn from
+        // `cpus`, or from all cpus if it is empty
+        bool pin_threads {};
+        std::vector<int> cpus;
+        // address space limit of each worker in MiB, 0 for unlimited
+        unsigned max_memory {};
+        std::chrono::milliseconds budget { 990ms };
+    };
+    using Handler = std::function<void(std::optional<botproto::Response>)>;
+
+    BotPool(asio::io_context& io_context, Options options)
+        : io_context_ { io_context }
+        , options_ { std::move(options) }
+    {
+        for (unsigned i = 0; i < options_.workers; i++) {
+            workers_.push_back(std::make_shared<Worker>(io_context_));
+            spawn(workers_.back());
+        }
+    }
+    BotPool(const BotPool&) = delete;
+    ~BotPool()
+    {
+        for (auto& worker : workers_)
+            terminate(*worker);
+    }
+
+    void query(const State& state, Handler handler)
+    {
+        dispatch({ botproto::Request { next_id_++, options_.budget, state }, std::move(handler) });
+    }
+
+private:
+    enum { max_attempts = 3 };
+    static constexpr auto restart_delay { 200ms };
+    static constexpr auto reap_interval { 10ms };
+    // a worker that answers this late after its search budget is taken for hung
+    static constexpr auto deadline_margin { 1s };
+
+    struct Query {
+        botproto::Request request;
+        Handler handler;
+        int attempts {};
+        std::shared_ptr<asio::steady_timer> deadline;
+    };
+    struct Worker {
+        pid_t pid { -1 };
+        asio::local::stream_protocol::socket socket;
+        asio::steady_timer timer;
+        std::map<std::uint32_t, Query> pending;
+        std::deque<botproto::RequestFrame> write_frames;
+        bool alive {};
+
+        Worker(asio::io_context& io_context)
+            : socket { io_context }
+            , timer { io_context }
+        {
+        }
+    };
+    using Worker_ptr = std::shared_ptr<Worker>;
+
+    void dispatch(Query query)
+    {
+        if (query.deadline)
+            query.deadline->cancel();
+        if (++query.attempts > max_attempts) {
+            logger->error("BotPool: query {} failed after {} attempts", query.request.id, max_attempts);
+            query.handler(std::nullopt);
+            return;
+        }
+        auto alive = workers_ | std::views::filter([](auto& w) { return w->alive; });
+        if (alive.empty()) {
+            // every worker is restarting, retry shortly
+            auto timer = std::make_shared<asio::steady_timer>(io_context_, restart_delay);
+            timer->async_wait([this, timer, query = std::move(query)](auto ec) mutable {
+                if (!ec)
+                    dispatch(std::move(query));
+            });
+            return;
+        }
+        auto worker = *std::ranges::min_element(alive, std::less {}, [](auto& w) { return w->pending.size(); });
+        worker->write_frames.push_back(botproto::encode(query.request));
+
+        // the worker searches one query at a time, the ones ahead of this come first
+        auto id { query.request.id };
+        auto budget { options_.budget * static_cast<int>(worker->pending.size() + 1) };
+        query.deadline = std::make_shared<asio::steady_timer>(io_context_, budget + deadline_margin);
+        query.deadline->async_wait([this, worker, id](auto ec) {
+            if (ec || !worker->pending.contains(id))
+                return;
+            logger->error("BotPool: worker {} did not answer query {} in time", worker->pid, id);
+            restart(worker);
+        });
+        worker->pending.emplace(id, std::move(query));
+        worker->timer.cancel_one();
+    }
+
+    void spawn(Worker_ptr worker)
+    {
+        asio::local::stream_protocol::socket child { io_context_ };
+        worker->socket = asio::local::stream_protocol::socket { io_context_ };
+        asio::local::connect_pair(worker->socket, child);
+
+        // the worker end is moved to fd 3 and every other descriptor is closed,
+        // so a worker never keeps another worker's socket alive
+        auto child_fd = child.native_handle();
+        auto max_fd = std::min(::sysconf(_SC_OPEN_MAX), 65536L);
+        std::string fd { "3" };
+        auto threads = std::to_string(options_.threads);
+        auto max_memory = std::to_string(options_.max_memory);
+        std::vector<char*> argv { options_.worker_path.data(), const_cast<char*>("--fd"), fd.data(), const_cast<char*>("--threads"), threads.data() };
+        if (options_.max_memory)
+            argv.insert(argv.end(), { const_cast<char*>("--max-memory"), max_memory.data() });
+        auto cpus = botproto::format_cpus(worker_cpus(worker));
+        if (options_.pin_threads)
+            argv.insert(argv.end(), { const_cast<char*>("--pin"), const_cast<char*>("--cpus"), cpus.data() });
+        argv.push_back(nullptr);
+
+        auto pid = ::fork();
+        if (pid == 0) {
+            ::dup2(child_fd, 3);
+            for (int i = 4; i < max_fd; i++)
+                ::close(i);
+            ::execv(argv[0], argv.data());
+            ::_exit(127);
+        }
+        child.close();
+        if (pid < 0) {
+            logger->error("BotPool: fork failed");
+            restart(worker);
+            return;
+        }
+
+        logger->info("BotPool: spawned worker {}", pid);
+        worker->pid = pid;
+        worker->alive = true;
+        worker->timer.expires_at(std::chrono::steady_clock::time_point::max());
+        co_spawn(io_context_, reader(worker), asio::detached);
+        co_spawn(io_context_, writer(worker), asio::detached);
+    }
+
+    // the cpus of the search threads of a worker, so that workers don't share them
+    std::vector<int> worker_cpus(const Worker_ptr& worker) const
+    {
+        auto available = options_.cpus;
+        if (available.empty()) {
+            available.resize(std::max(std::thread::hardware_concurrency(), 1u));
+            std::iota(available.begin(), available.end(), 0);
+        }
+        auto first = static_cast<std::size_t>(std::ranges::find(workers_, worker) - workers_.begin()) * options_.threads;
+        std::vector<int> cpus;
+        for (std::size_t i = 0; i < std::max(options_.threads, 1u); i++)
+            cpus.push_back(available[(first + i) % available.size()]);
+        return cpus;
+    }
+
+    void terminate(Worker& worker)
+    {
+        worker.alive = false;
+        for (auto& [id, query] : worker.pending)
+            query.deadline->cancel();
+        asio::error_code ec;
+        worker.socket.close(ec);
+        worker.timer.cancel();
+        if (worker.pid > 0) {
+            ::kill(worker.pid, SIGKILL);
+            reap(io_context_, worker.pid);
+            worker.pid = -1;
+        }
+    }
+
+    // waits for a killed worker without blocking the io thread, polling until
+    // it has exited
+    static void reap(asio::io_context& io_context, pid_t pid)
+    {
+        if (::waitpid(pid, nullptr, WNOHANG) != 0)
+            return;
+        auto timer = std::make_shared<asio::steady_timer>(io_context, reap_interval);
+        timer->async_wait([&io_context, timer, pid](auto ec) {
+            if (!ec)
+                reap(io_context, pid);
+        });
+    }
+
+    void restart(Worker_ptr worker)
+    {
+        if (worker->alive)
+            logger->error("BotPool: worker {} failed, restarting", worker->pid);
+        terminate(*worker);
+        worker->write_frames.clear();
+        auto pending { std::move(worker->pending) };
+        worker->pending.clear();
+
+        auto timer = std::make_shared<asio::steady_timer>(io_context_, restart_delay);
+        timer->async_wait([this, timer, worker](auto ec) {
+            if (!ec)
+                spawn(worker);
+        });
+        for (auto& [id, query] : pending)
+            dispatch(std::move(query));
+    }
+
+    // the search profiles of the workers end up in our metrics, as if they had
+    // searched in this process, and so do their allocations
+    void report([[maybe_unused]] std::string_view profile)
+    {
+#ifdef NOGO_MCTS_PROFILE
+        if (auto decoded = MCTSProfile::load(profile))
+            decoded->report();
+        else
+            logger->warn("BotPool: dropped a profile of {} bytes", profile.size());
+#endif
+    }
+
+    awaitable<void> reader(Worker_ptr worker)
+    {
+        try {
+            for (botproto::ResponseFrame frame;;) {
+                co_await asio::async_read(worker->socket, asio::buffer(frame), use_awaitable);
+                auto response = botproto::decode(frame);
+                if (auto size = botproto::profile_size(frame); size > botproto::max_profile_size)
+                    throw std::length_error("BotPool: profile too large");
+                else if (size) {
+                    response.profile.resize(size);
+                    co_await asio::async_read(worker->socket, asio::buffer(response.profile), use_awaitable);
+                    report(response.profile);
+                }
+                if (auto& allocations = response.allocations; allocations.events) {
+                    metrics.add("alloc.mcts_search.events", allocations.events);
+                    metrics.add("alloc.mcts_search.count", allocations.count);
+                    metrics.add("alloc.mcts_search.bytes", allocations.bytes);
+                }
+                auto it = worker->pending.find(response.id);
+                if (it == worker->pending.end())
+                    continue;
+                auto handler = std::move(it->second.handler);
+                it->second.deadline->cancel();
+                worker->pending.erase(it);
+                logger->info("BotPool: worker {} played {} with {} playouts in {}ms", worker->pid, response.move ? response.move.to_string() : "no move", response.playouts, response.elapsed.count() / 1000);
+                handler(response);
+            }
+        } catch (std::exception& e) {
+            if (worker->alive)
+                restart(worker);
+        }
+    }
+
+    awaitable<void> writer(Worker_ptr worker)
+    {
+        try {
+            while (worker->alive) {
+                if (worker->write_frames.empty()) {
+                    asio::error_code ec;
+                    co_await worker->timer.async_wait(redirect_error(use_awaitable, ec));
+                } else {
+                    auto frame = worker->write_frames.front();
+                    co_await asio::async_write(worker->socket, asio::buffer(frame), use_awaitable);
+                    worker->write_frames.pop_front();
+                }
+            }
+        } catch (std::exception& e) {
+            if (worker->alive)
+                restart(worker);
+        }
+    }
+
+    asio::io_context& io_context_;
+    Options options_;
+    std::vector<Worker_ptr> workers_;
+    std::uint32_t next_id_ {};
+};
+
+#endif
@@ -0,0 +1,153 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "packed.hpp"
+#include "rule.hpp"
+
+// Binary frames exchanged between nogo-server and nogo-bot-worker: a position
+// goes in, packed, and a move and search statistics come out. A response frame
+// is followed by profile_size bytes of MCTSProfile when the worker was built
+// with NOGO_MCTS_PROFILE, and carries what the search allocated when it was
+// built with NOGO_ALLOC_TRACKING.
+namespace botproto {
+
+constexpr std::size_t request_size = 4 + 2 + 1 + packed::size;
+constexpr std::size_t response_size = 4 + 1 + 4 + 4 + 4 + 3 * 8;
+// larger trailers are garbage, MCTSProfile is well below this
+constexpr std::size_t max_profile_size = 64 << 10;
+
+using RequestFrame = std::array<char, request_size>;
+using ResponseFrame = std::array<char, response_size>;
+
+_EXPORT struct Request {
+    std::uint32_t id;
+    std::chrono::milliseconds budget;
+    State state;
+};
+
+_EXPORT struct Response {
+    std::uint32_t id;
+    Point move;
+    std::uint32_t playouts;
+    std::chrono::microseconds elapsed;
+    // MCTSProfile::save() of the search, empty without NOGO_MCTS_PROFILE
+    std::string profile;
+    // the alloc.mcts_search.{events,count,bytes} of the search, zero without
+    // NOGO_ALLOC_TRACKING
+    struct Allocations {
+        std::uint64_t events, count, bytes;
+    } allocations;
+};
+
+constexpr void put_u16(char* p, std::uint16_t v)
+{
+    p[0] = static_cast<char>(v & 0xff), p[1] = static_cast<char>(v >> 8);
+}
+constexpr void put_u32(char* p, std::uint32_t v)
+{
+    put_u16(p, v & 0xffff), put_u16(p + 2, v >> 16);
+}
+constexpr void put_u64(char* p, std::uint64_t v)
+{
+    put_u32(p, v & 0xffffffff), put_u32(p + 4, v >> 32);
+}
+constexpr auto get_u16(const char* p) -> std::uint16_t
+{
+    return static_cast<std::uint8_t>(p[0]) | static_cast<std::uint8_t>(p[1]) << 8;
+}
+constexpr auto get_u32(const char* p) -> std::uint32_t
+{
+    return get_u16(p) | static_cast<std::uint32_t>(get_u16(p + 2)) << 16;
+}
+constexpr auto get_u64(const char* p) -> std::uint64_t
+{
+    return get_u32(p) | static_cast<std::uint64_t>(get_u32(p + 4)) << 32;
+}
+
+_EXPORT inline auto encode(const Request& request)
+{
+    RequestFrame frame {};
+    put_u32(&frame[0], request.id);
+    put_u16(&frame[4], static_cast<std::uint16_t>(request.budget.count()));
+    frame[6] = static_cast<char>(request.state.last_move.index);
+    auto position { packed::pack(request.state) };
+    std::memcpy(&frame[7], position.bytes.data(), position.bytes.size());
+    return frame;
+}
+
+_EXPORT inline auto decode(const RequestFrame& frame)
+{
+    Request request;
+    request.id = get_u32(&frame[0]);
+    request.budget = std::chrono::milliseconds { get_u16(&frame[4]) };
+    request.state.last_move = Point { static_cast<std::uint8_t>(frame[6]) };
+    packed::PackedState position;
+    std::memcpy(position.bytes.data(), &frame[7], position.bytes.size());
+    std::tie(request.state.board, request.state.role) = packed::unpack(position);
+    return request;
+}
+
+// cpu lists on the worker command line are comma separated, e.g. "0,2,4"
+_EXPORT inline auto parse_cpus(std::string_view list)
+{
+    std::vector<int> cpus;
+    while (!list.empty()) {
+        auto comma = list.find(',');
+        cpus.push_back(std::stoi(std::string { list.substr(0, comma) }));
+        list.remove_prefix(comma == list.npos ? list.size() : comma + 1);
+    }
+    return cpus;
+}
+
+_EXPORT inline auto format_cpus(const std::vector<int>& cpus)
+{
+    std::string list;
+    for (auto cpu : cpus)
+        list += (list.empty() ? "" : ",") + std::to_string(cpu);
+    return list;
+}
+
+_EXPORT inline auto encode(const Response& response)
+{
+    ResponseFrame frame {};
+    put_u32(&frame[0], response.id);
+    frame[4] = static_cast<char>(response.move.index);
+    put_u32(&frame[5], response.playouts);
+    put_u32(&frame[9], static_cast<std::uint32_t>(response.elapsed.count()));
+    put_u32(&frame[13], static_cast<std::uint32_t>(response.profile.size()));
+    put_u64(&frame[17], response.allocations.events);
+    put_u64(&frame[25], response.allocations.count);
+    put_u64(&frame[33], response.allocations.bytes);
+    return frame;
+}
+
+_EXPORT inline auto decode(const ResponseFrame& frame)
+{
+    return Response {
+        get_u32(&frame[0]),
+        Point { static_cast<std::uint8_t>(frame[4]) },
+        get_u32(&frame[5]),
+        std::chrono::microseconds { get_u32(&frame[9]) },
+        {},
+        { get_u64(&frame[17]), get_u64(&frame[25]), get_u64(&frame[33]) },
+    };
+}
+
+// bytes of the profile following the frame
+_EXPORT inline auto profile_size(const ResponseFrame& frame) -> std::size_t
+{
+    return get_u32(&frame[13]);
+}
+
+}
@@ -0,0 +1,123 @@
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "bot.hpp"
+#include "botproto.hpp"
+
+// Search worker spawned by BotPool. It talks to nogo-server over an inherited
+// unix domain socket and serves one request at a time, so a crash or a memory
+// blowup only takes this process down.
+
+bool read_exact(int fd, char* data, std::size_t size)
+{
+    while (size) {
+        auto n = ::read(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n, size -= n;
+    }
+    return true;
+}
+
+bool write_exact(int fd, const char* data, std::size_t size)
+{
+    while (size) {
+        auto n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n, size -= n;
+    }
+    return true;
+}
+
+#ifdef NOGO_ALLOC_TRACKING
+// what the searches of this worker have allocated so far
+auto search_allocations()
+{
+    return botproto::Response::Allocations {
+        static_cast<std::uint64_t>(metrics.get("alloc.mcts_search.events")),
+        static_cast<std::uint64_t>(metrics.get("alloc.mcts_search.count")),
+        static_cast<std::uint64_t>(metrics.get("alloc.mcts_search.bytes")),
+    };
+}
+#endif
+
+auto main(int argc, char* argv[]) -> int
+{
+    int fd { -1 };
+    SearchOptions options;
+    std::string trace_file;
+    for (int i = 1; i < argc; i++) {
+        std::string_view key { argv[i] };
+        if (key == "--pin") {
+            options.pin_threads = true;
+            continue;
+        }
+        if (i + 1 == argc)
+            break;
+        auto value = std::atoi(argv[++i]);
+        if (key == "--fd")
+            fd = value;
+        else if (key == "--threads")
+            options.threads = value;
+        else if (key == "--cpus")
+            options.cpus = botproto::parse_cpus(argv[i]);
+        else if (key == "--trace")
+            trace_file = argv[i];
+        else if (key == "--max-memory") {
+            rlimit limit { static_cast<rlim_t>(value) << 20, static_cast<rlim_t>(value) << 20 };
+            setrlimit(RLIMIT_AS, &limit);
+        }
+    }
+    if (fd < 0) {
+        std::cerr << "Usage: nogo-bot-worker --fd <fd> [--threads <n>] [--pin] [--cpus <cpu>,...] [--max-memory <MiB>] [--trace <file>]\n";
+        return 1;
+    }
+    trace::enabled = !trace_file.empty();
+    // the server owns ./logs, workers log to the inherited stderr
+    logger = spdlog::logger("bot-worker", std::make_shared<spdlog::sinks::stderr_color_sink_mt>());
+
+    for (botproto::RequestFrame frame; read_exact(fd, frame.data(), frame.size());) {
+        auto request = botproto::decode(frame);
+        auto start = chrono::steady_clock::now();
+        botproto::Response response {};
+        response.id = request.id;
+
+        if (!request.state.available_actions().empty()) {
+            options.budget = request.budget;
+#ifdef NOGO_ALLOC_TRACKING
+            auto before { search_allocations() };
+#endif
+            auto result = mcts_parallel_search(request.state, options);
+#ifdef NOGO_ALLOC_TRACKING
+            auto after { search_allocations() };
+            response.allocations = { after.events - before.events, after.count - before.count, after.bytes - before.bytes };
+#endif
+            response.move = result.best_action();
+            response.playouts = result.playouts;
+#ifdef NOGO_MCTS_PROFILE
+            response.profile = result.profile.save();
+#endif
+        }
+        response.elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+
+        auto out = botproto::encode(response);
+        if (!write_exact(fd, out.data(), out.size()) || !write_exact(fd, response.profile.data(), response.profile.size()))
+            break;
+    }
+    if (trace::enabled)
+        trace::dump(trace_file);
+}
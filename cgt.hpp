@@ -0,0 +1,275 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "rule.hpp"
+
+// Combinatorial game theory for the endgame. No-go is played under the normal
+// play convention, who has no legal move left loses, so once the board has
+// split into regions (see Board::regions) a position is the sum of its
+// regions as games. The winner of the sum follows from the canonical value of
+// each region, and each region is searched once on its own instead of every
+// interleaving of moves across all of them.
+namespace cgt {
+
+using Game = std::uint32_t;
+
+// Short games in canonical form, interned so that equal values share an id.
+// Black is Left.
+_EXPORT class Games {
+public:
+    static constexpr Game zero = 0;
+
+    Games()
+    {
+        nodes_.push_back({});
+        index_[{}] = zero;
+    }
+
+    auto left(Game g) const -> const std::vector<Game>& { return nodes_[g].left; }
+    auto right(Game g) const -> const std::vector<Game>& { return nodes_[g].right; }
+    auto size() const { return nodes_.size(); }
+
+    // the canonical form of { left | right }
+    auto make(std::vector<Game> left_options, std::vector<Game> right_options) -> Game
+    {
+        Options g { std::move(left_options), std::move(right_options) };
+        for (bool changed = true; changed;) {
+            changed = false;
+            remove_dominated(g.left, [&](Game a, Game b) { return le(a, b); });
+            remove_dominated(g.right, [&](Game a, Game b) { return le(b, a); });
+            // a Left option reverses through a Right reply at most G, and is
+            // replaced by the Left options of that reply; the same goes for Right
+            for (auto& option : g.left)
+                if (auto it = std::ranges::find_if(right(option), [&](Game reply) { return le(reply, g); }); it != right(option).end()) {
+                    replace(g.left, option, left(*it));
+                    changed = true;
+                    break;
+                }
+            if (changed)
+                continue;
+            for (auto& option : g.right)
+                if (auto it = std::ranges::find_if(left(option), [&](Game reply) { return le(g, reply); }); it != left(option).end()) {
+                    replace(g.right, option, right(*it));
+                    changed = true;
+                    break;
+                }
+        }
+        if (auto it = index_.find(g); it != index_.end())
+            return it->second;
+        nodes_.push_back(g);
+        return index_[std::move(g)] = static_cast<Game>(nodes_.size() - 1);
+    }
+
+    // g <= h: Left has no option from g at least h, Right none from h at most g
+    bool le(Game g, Game h)
+    {
+        if (g == h)
+            return true;
+        auto key { std::uint64_t { g } << 32 | h };
+        if (auto it = le_cache_.find(key); it != le_cache_.end())
+            return it->second;
+        auto res { std::ranges::none_of(left(g), [&](Game option) { return le(h, option); })
+            && std::ranges::none_of(right(h), [&](Game option) { return le(option, g); }) };
+        return le_cache_[key] = res;
+    }
+
+    auto add(Game g, Game h) -> Game
+    {
+        if (g == zero || h == zero)
+            return g == zero ? h : g;
+        auto key { std::uint64_t { std::min(g, h) } << 32 | std::max(g, h) };
+        if (auto it = add_cache_.find(key); it != add_cache_.end())
+            return it->second;
+        // copies, as adding interns new games
+        auto g_options { nodes_[g] }, h_options { nodes_[h] };
+        std::vector<Game> left, right;
+        for (auto option : g_options.left)
+            left.push_back(add(option, h));
+        for (auto option : h_options.left)
+            left.push_back(add(g, option));
+        for (auto option : g_options.right)
+            right.push_back(add(option, h));
+        for (auto option : h_options.right)
+            right.push_back(add(g, option));
+        return add_cache_[key] = make(std::move(left), std::move(right));
+    }
+
+    // who wins `g` with `to_move` to play: Black if g > 0, White if g < 0,
+    // the second player if g = 0 and the first one if g is fuzzy
+    auto winner(Game g, Role to_move) -> Role
+    {
+        auto positive { le(zero, g) }, negative { le(g, zero) };
+        if (positive && negative)
+            return -to_move;
+        return positive ? Role::BLACK : negative ? Role::WHITE
+                                                 : to_move;
+    }
+
+private:
+    struct Options {
+        std::vector<Game> left, right;
+        auto operator<=>(const Options&) const = default;
+    };
+
+    // comparisons with a game being canonicalized, which has no id yet
+    bool le(const Options& g, Game h)
+    {
+        return std::ranges::none_of(g.left, [&](Game option) { return le(h, option); })
+            && std::ranges::none_of(right(h), [&](Game option) { return le(option, g); });
+    }
+    bool le(Game h, const Options& g)
+    {
+        return std::ranges::none_of(left(h), [&](Game option) { return le(g, option); })
+            && std::ranges::none_of(g.right, [&](Game option) { return le(option, h); });
+    }
+
+    // keeps one of equal options, and none that another one beats
+    static void remove_dominated(std::vector<Game>& options, auto&& worse)
+    {
+        std::ranges::sort(options);
+        options.erase(std::ranges::unique(options).begin(), options.end());
+        std::vector<Game> kept;
+        for (auto option : options)
+            if (std::ranges::none_of(options, [&](Game other) { return other != option && worse(option, other); }))
+                kept.push_back(option);
+        options = std::move(kept);
+    }
+    static void replace(std::vector<Game>& options, Game option, const std::vector<Game>& by)
+    {
+        std::erase(options, option);
+        options.insert(options.end(), by.begin(), by.end());
+    }
+
+    std::vector<Options> nodes_;
+    std::map<Options, Game> index_;
+    std::unordered_map<std::uint64_t, bool> le_cache_;
+    std::unordered_map<std::uint64_t, Game> add_cache_;
+};
+
+// Values No-go positions region by region. Regions of more than `max_region`
+// empty points are not valued, their values would take too long to search.
+// `Board` is the 9x9 board of rule.hpp or one of the small boards of
+// solver.hpp: a set of points with count(), first(), test() and reset(), the
+// stones of a color and the regions of empty points as such sets, and a move
+// as the board after it, none if it is not legal.
+_EXPORT template <typename Board = ::Board>
+class Evaluator {
+public:
+    using Set = decltype(std::declval<const Board&>().empty());
+    using Region = typename decltype(std::declval<const Board&>().regions())::value_type;
+    using Point = decltype(std::declval<const Set&>().first());
+
+    explicit Evaluator(int max_region = 10)
+        : max_region_ { max_region }
+    {
+    }
+
+    auto games() -> Games& { return games_; }
+
+    auto value(const Board& board, const Region& region) -> std::optional<Game>
+    {
+        if (region.empty.count() > max_region_)
+            return std::nullopt;
+        std::array key { board.stones(Role::BLACK) & region.stones, board.stones(Role::WHITE) & region.stones, region.empty };
+        if (auto it = values_.find(key); it != values_.end())
+            return it->second;
+        std::vector<Game> left, right;
+        for (auto rest { region.empty }; rest; rest.reset(rest.first())) {
+            if (auto option = this->option(board, region, rest.first(), Role::BLACK))
+                left.push_back(*option);
+            if (auto option = this->option(board, region, rest.first(), Role::WHITE))
+                right.push_back(*option);
+        }
+        return values_[key] = games_.make(std::move(left), std::move(right));
+    }
+
+    // the sum of the regions, none if one of them is too large, which is
+    // found before searching any of them
+    auto value(const Board& board) -> std::optional<Game>
+    {
+        auto regions { board.regions() };
+        if (std::ranges::any_of(regions, [&](auto& region) { return region.empty.count() > max_region_; }))
+            return std::nullopt;
+        auto res { Games::zero };
+        for (auto& region : regions)
+            res = games_.add(res, *value(board, region));
+        return res;
+    }
+
+    // the winner with perfect play, none if a region is too large
+    auto winner(const Board& board, Role to_move) -> std::optional<Role>
+    {
+        if (auto value = this->value(board))
+            return games_.winner(*value, to_move);
+        return std::nullopt;
+    }
+
+    // Moves the side to move never needs to play, those that leave their
+    // region at a value no better than another move there, go last. Returns
+    // how many moves are left before them.
+    template <typename Moves>
+    auto order(const Board& board, Role to_move, Moves& moves) -> std::size_t
+    {
+        std::vector<std::pair<Point, Game>> options;
+        std::vector<Point> dominated;
+        for (auto& region : board.regions()) {
+            if (region.empty.count() > max_region_)
+                continue;
+            options.clear();
+            for (auto move : moves)
+                if (region.empty.test(move))
+                    if (auto option = this->option(board, region, move, to_move))
+                        options.emplace_back(move, *option);
+            auto better = [&](Game a, Game b) { return to_move == Role::BLACK ? games_.le(b, a) : games_.le(a, b); };
+            for (std::size_t i = 0; i < options.size(); i++)
+                for (std::size_t j = 0; j < options.size(); j++)
+                    if (i != j && better(options[j].second, options[i].second)
+                        && (options[i].second != options[j].second || j < i)) {
+                        dominated.push_back(options[i].first);
+                        break;
+                    }
+        }
+        auto rest { std::ranges::stable_partition(moves, [&](Point move) { return std::ranges::find(dominated, move) == dominated.end(); }) };
+        return rest.begin() - moves.begin();
+    }
+
+private:
+    // the region after `role` plays at `p`, which may split it; none if the
+    // move is not legal
+    auto option(const Board& board, const Region& region, Point p, Role role) -> std::optional<Game>
+    {
+        auto next { board.play(p, role) };
+        if (!next)
+            return std::nullopt;
+        auto rest { region.empty };
+        rest.reset(p);
+        auto res { Games::zero };
+        for (auto& part : next->regions(rest))
+            res = games_.add(res, *value(*next, part));
+        return res;
+    }
+
+    int max_region_;
+    Games games_;
+    // the stones of each color and the empty points of a region; sets are
+    // plain words, hashed as bytes
+    using Key = std::array<Set, 3>;
+    struct Hash {
+        auto operator()(const Key& key) const { return std::hash<std::string_view> {}({ reinterpret_cast<const char*>(&key), sizeof(key) }); }
+    };
+    std::unordered_map<Key, Game, Hash> values_;
+};
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "message.hpp"
+
+using nlohmann::json;
+
+// The last `capacity` chat messages of one audience, kept serialized exactly
+// as they were delivered, so a late joiner is caught up without serializing
+// anything again. A message is serialized once, into a string of its own that
+// takes the place of the oldest one.
+_EXPORT class ChatHistory {
+public:
+    explicit ChatHistory(std::size_t capacity = 100)
+        : slots_(capacity)
+    {
+    }
+
+    // returns the serialized message
+    auto append(Message msg) -> std::string_view
+    {
+        auto& slot { slots_[(first_ + size_) % slots_.size()] };
+        slot = msg.to_string();
+        if (size_ < slots_.size())
+            size_++;
+        else
+            first_ = (first_ + 1) % slots_.size();
+        return slot;
+    }
+
+    // oldest first, valid until the next append
+    auto entries() const
+    {
+        std::vector<std::string_view> res;
+        res.reserve(size_);
+        for (std::size_t i = 0; i < size_; i++)
+            res.push_back(slots_[(first_ + i) % slots_.size()]);
+        return res;
+    }
+    auto size() const { return size_; }
+
+private:
+    std::vector<std::string> slots_;
+    std::size_t first_ {}, size_ {};
+};
+
+// Appends chat to a file as JSON lines on a thread of its own, so the room
+// never waits for the disk. Lines still queued are written on destruction.
+_EXPORT class ChatLog {
+public:
+    explicit ChatLog(const std::string& path)
+        : out_ { path, std::ios::app }
+    {
+        if (!out_)
+            throw std::runtime_error("cannot open chat log " + path);
+        thread_ = std::jthread { [this](std::stop_token stop) { run(stop); } };
+    }
+    ChatLog(const ChatLog&) = delete;
+
+    // `message` is a serialized Message
+    void append(std::string_view from, std::string_view message)
+    {
+        auto now { std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() };
+        auto line { R"({"time":)" + std::to_string(now) + R"(,"from":)" + json(from).dump() + R"(,"message":)" };
+        line += message;
+        line += "}\n";
+        {
+            std::lock_guard lock { mutex_ };
+            queue_.push_back(std::move(line));
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void run(std::stop_token stop)
+    {
+        std::vector<std::string> batch;
+        for (;;) {
+            {
+                std::unique_lock lock { mutex_ };
+                cv_.wait(lock, stop, [this] { return !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+                batch.swap(queue_);
+            }
+            for (auto& line : batch)
+                out_ << line;
+            out_.flush();
+            batch.clear();
+        }
+    }
+
+    std::ofstream out_;
+    std::mutex mutex_;
+    std::condition_variable_any cv_;
+    std::vector<std::string> queue_;
+    // last, so the writer stops before the queue it drains is destroyed
+    std::jthread thread_;
+};
@@ -0,0 +1,160 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <system_error>
+#include <utility>
+
+// Where the room gets the time from. The server runs on the steady clock;
+// a VirtualClock only moves when told to, so that what happens after 30s
+// without a move can be played out in no time, and to the nanosecond.
+namespace timing {
+
+_EXPORT class Clock {
+public:
+    using duration = std::chrono::steady_clock::duration;
+    using time_point = std::chrono::steady_clock::time_point;
+    using Handler = std::function<void(const asio::error_code&)>;
+
+    // as asio::steady_timer: setting the expiry cancels the wait, and
+    // handlers run on the io_context, with operation_aborted if cancelled
+    class Timer {
+    public:
+        virtual ~Timer() = default;
+        virtual void expires_after(duration d) = 0;
+        virtual auto expiry() const -> time_point = 0;
+        virtual void async_wait(Handler handler) = 0;
+        virtual void cancel() = 0;
+    };
+
+    virtual ~Clock() = default;
+    virtual auto now() const -> time_point = 0;
+    virtual auto timer() -> std::unique_ptr<Timer> = 0;
+};
+
+_EXPORT class SteadyClock : public Clock {
+public:
+    explicit SteadyClock(asio::io_context& io_context)
+        : io_context_ { io_context }
+    {
+    }
+
+    auto now() const -> time_point override { return std::chrono::steady_clock::now(); }
+    auto timer() -> std::unique_ptr<Timer> override { return std::make_unique<SteadyTimer>(io_context_); }
+
+private:
+    class SteadyTimer : public Timer {
+    public:
+        explicit SteadyTimer(asio::io_context& io_context)
+            : timer_ { io_context }
+        {
+        }
+        void expires_after(duration d) override { timer_.expires_after(d); }
+        auto expiry() const -> time_point override { return timer_.expiry(); }
+        void async_wait(Handler handler) override { timer_.async_wait(std::move(handler)); }
+        void cancel() override { timer_.cancel(); }
+
+    private:
+        asio::steady_timer timer_;
+    };
+
+    asio::io_context& io_context_;
+};
+
+// Time that stands still until advance(). The clock must outlive its timers.
+_EXPORT class VirtualClock : public Clock {
+public:
+    explicit VirtualClock(asio::io_context& io_context, time_point start = {})
+        : io_context_ { io_context }
+        , now_ { start }
+    {
+    }
+
+    auto now() const -> time_point override { return now_; }
+    auto timer() -> std::unique_ptr<Timer> override { return std::make_unique<VirtualTimer>(*this); }
+
+    // Moves the time forward by `d`. Every wait that falls due on the way
+    // runs at its own time, in order, and so do the waits its handler starts
+    // if they fall due before the end.
+    void advance(duration d)
+    {
+        auto end { now_ + d };
+        while (!waits_.empty() && waits_.begin()->first <= end) {
+            auto wait { waits_.extract(waits_.begin()) };
+            now_ = std::max(now_, wait.key());
+            asio::post(io_context_, [handler = std::move(wait.mapped().handler)] { handler({}); });
+            poll();
+        }
+        now_ = end;
+        poll();
+    }
+    // waits yet to fall due
+    auto pending() const { return waits_.size(); }
+
+private:
+    // the io_context stops whenever it runs out of work, and would not run
+    // what is posted next
+    void poll()
+    {
+        if (io_context_.stopped())
+            io_context_.restart();
+        io_context_.poll();
+    }
+
+    struct Wait {
+        const Timer* timer;
+        Handler handler;
+    };
+
+    class VirtualTimer : public Timer {
+    public:
+        explicit VirtualTimer(VirtualClock& clock)
+            : clock_ { clock }
+        {
+        }
+        ~VirtualTimer() override { cancel(); }
+
+        void expires_after(duration d) override
+        {
+            cancel();
+            expiry_ = clock_.now_ + d;
+        }
+        auto expiry() const -> time_point override { return expiry_; }
+        void async_wait(Handler handler) override
+        {
+            if (expiry_ <= clock_.now_)
+                asio::post(clock_.io_context_, [handler = std::move(handler)] { handler({}); });
+            else
+                clock_.waits_.emplace(expiry_, Wait { this, std::move(handler) });
+        }
+        void cancel() override
+        {
+            for (auto it = clock_.waits_.begin(); it != clock_.waits_.end();)
+                if (it->second.timer == this) {
+                    asio::post(clock_.io_context_, [handler = std::move(it->second.handler)] { handler(asio::error::operation_aborted); });
+                    it = clock_.waits_.erase(it);
+                } else
+                    ++it;
+        }
+
+    private:
+        VirtualClock& clock_;
+        time_point expiry_ {};
+    };
+
+    asio::io_context& io_context_;
+    time_point now_;
+    std::multimap<time_point, Wait> waits_;
+};
+
+}
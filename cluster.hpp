@@ -0,0 +1,863 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <asio/awaitable.hpp>
+#include <asio/co_spawn.hpp>
+#include <asio/connect.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/read.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/use_awaitable.hpp>
+#include <asio/write.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "contest.hpp"
+#include "log.hpp"
+#include "message.hpp"
+
+using asio::awaitable;
+using asio::co_spawn;
+using asio::detached;
+using asio::redirect_error;
+using asio::use_awaitable;
+using asio::ip::tcp;
+using nlohmann::json;
+using namespace std::chrono_literals;
+using std::chrono::milliseconds;
+
+// Cluster mode: nogo-server processes listed in a static config file link up
+// over an internal binary protocol, which they open with the secret of the
+// config. Which node knows where a player is
+// connected is decided by a consistent-hash ring over the player names, so
+// requests and chat for a player on another node are routed through the
+// owner of that name to the player's node, and proxied there as if the
+// sender had connected directly.
+namespace cluster {
+
+_EXPORT struct Node {
+    std::string id;
+    std::string host;
+    // where frontends and remote players connect, and the internal link
+    asio::ip::port_type port {}, peer_port {}, link_port {};
+
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE(Node, id, host, port, peer_port, link_port)
+};
+
+// {"secret": "...", "nodes": [{"id": "a", "host": "127.0.0.1", "port": 5001, "peer_port": 5002, "link_port": 6001}, ...]}
+_EXPORT struct Config {
+    // every link opens with it; the links are not encrypted, so they belong
+    // on a private network all the same
+    std::string secret;
+    std::vector<Node> nodes;
+
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE(Config, secret, nodes)
+
+    static auto load(const std::string& path)
+    {
+        std::ifstream in { path };
+        if (!in)
+            throw std::runtime_error("cannot open cluster config " + path);
+        auto config { json::parse(in).get<Config>() };
+        if (config.secret.empty())
+            throw std::runtime_error("cluster config " + path + " has no secret");
+        return config;
+    }
+    auto node(std::string_view id) const -> const Node&
+    {
+        for (auto& node : nodes)
+            if (node.id == id)
+                return node;
+        throw std::runtime_error("node " + std::string { id } + " is not in the cluster config");
+    }
+};
+
+// FNV-1a, so every node computes the same ring whatever its standard library
+constexpr auto hash(std::string_view key) -> std::uint64_t
+{
+    std::uint64_t h { 14695981039346656037ull };
+    for (unsigned char c : key)
+        h = (h ^ c) * 1099511628211ull;
+    // FNV spreads short keys poorly over the high bits, finish with a mix
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Every node owns `vnodes` points on the ring, and a key belongs to the first
+// point at or after its hash. The ring is built from the config and never
+// changes: a node that is down keeps its keys, frames for it wait in the link
+// queue, and the nodes send it its directory shard again when it is back.
+_EXPORT class HashRing {
+public:
+    explicit HashRing(unsigned vnodes = 64)
+        : vnodes_ { vnodes }
+    {
+    }
+    void add(const std::string& node)
+    {
+        for (unsigned i = 0; i < vnodes_; i++)
+            points_[hash(node + "#" + std::to_string(i))] = node;
+    }
+    auto owner(std::string_view key) const -> const std::string&
+    {
+        if (points_.empty())
+            throw std::logic_error("empty hash ring");
+        auto it { points_.lower_bound(hash(key)) };
+        return (it == points_.end() ? points_.begin() : it)->second;
+    }
+
+private:
+    unsigned vnodes_;
+    std::map<std::uint64_t, std::string> points_;
+};
+
+// Link frames: u32 length of what follows, u8 type, then the fields of the
+// type, strings as u16 length and bytes, integers little endian.
+enum class FrameType : std::uint8_t {
+    // the first frame of every link: the node that dialed, and the secret in
+    // the payload
+    HELLO,
+    // the player is connected to the node, sent to the owner of the name
+    REGISTER,
+    UNREGISTER,
+    // a message from one player to another; to_node is empty until the
+    // owner of to_user has looked it up
+    ROUTE,
+    // a room snapshot offered to another node, and its answer: an empty
+    // payload if the room was taken over, otherwise why not
+    MIGRATE,
+    MIGRATED,
+    // input that reached a room while it was frozen, for the slot `to_user`
+    // of the migrated room
+    MIGRATE_INPUT,
+};
+
+_EXPORT struct Frame {
+    FrameType type {};
+    std::string node;
+    std::string from_user, from_node, to_user, to_node;
+    Message msg;
+    std::string payload;
+};
+
+inline void put_u32(std::string& out, std::uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(static_cast<char>(v >> (8 * i)));
+}
+inline void put_string(std::string& out, std::string_view s)
+{
+    if (s.size() > 0xffff)
+        throw std::length_error("cluster frame field too long");
+    out.push_back(static_cast<char>(s.size() & 0xff));
+    out.push_back(static_cast<char>(s.size() >> 8));
+    out += s;
+}
+inline void put_long_string(std::string& out, std::string_view s)
+{
+    put_u32(out, static_cast<std::uint32_t>(s.size()));
+    out += s;
+}
+
+class Reader {
+public:
+    explicit Reader(std::string_view data)
+        : data_ { data }
+    {
+    }
+    auto u8() -> std::uint8_t
+    {
+        need(1);
+        auto v { static_cast<std::uint8_t>(data_[0]) };
+        data_.remove_prefix(1);
+        return v;
+    }
+    auto u32() -> std::uint32_t
+    {
+        need(4);
+        std::uint32_t v {};
+        for (int i = 0; i < 4; i++)
+            v |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(data_[i])) << (8 * i);
+        data_.remove_prefix(4);
+        return v;
+    }
+    auto string() -> std::string
+    {
+        need(2);
+        std::size_t n { static_cast<std::uint8_t>(data_[0]) | static_cast<std::size_t>(static_cast<std::uint8_t>(data_[1])) << 8 };
+        data_.remove_prefix(2);
+        need(n);
+        std::string s { data_.substr(0, n) };
+        data_.remove_prefix(n);
+        return s;
+    }
+    auto long_string() -> std::string
+    {
+        auto n { u32() };
+        need(n);
+        std::string s { data_.substr(0, n) };
+        data_.remove_prefix(n);
+        return s;
+    }
+
+private:
+    void need(std::size_t n)
+    {
+        if (data_.size() < n)
+            throw std::runtime_error("truncated cluster frame");
+    }
+    std::string_view data_;
+};
+
+// the whole frame, length prefix included
+_EXPORT inline auto encode(const Frame& frame) -> std::string
+{
+    std::string out(4, '\0');
+    out.push_back(static_cast<char>(frame.type));
+    switch (frame.type) {
+    case FrameType::HELLO:
+        put_string(out, frame.node);
+        put_string(out, frame.payload);
+        break;
+    case FrameType::REGISTER:
+    case FrameType::UNREGISTER:
+        put_string(out, frame.from_user);
+        put_string(out, frame.node);
+        break;
+    case FrameType::ROUTE:
+        put_string(out, frame.from_user);
+        put_string(out, frame.from_node);
+        put_string(out, frame.to_user);
+        put_string(out, frame.to_node);
+        put_u32(out, static_cast<std::uint32_t>(frame.msg.op));
+        put_string(out, frame.msg.data1);
+        put_string(out, frame.msg.data2);
+        break;
+    case FrameType::MIGRATE:
+    case FrameType::MIGRATED:
+        put_string(out, frame.node);
+        put_string(out, frame.from_user);
+        put_long_string(out, frame.payload);
+        break;
+    case FrameType::MIGRATE_INPUT:
+        put_string(out, frame.from_user);
+        put_string(out, frame.to_user);
+        put_long_string(out, frame.payload);
+        break;
+    }
+    std::string length;
+    put_u32(length, static_cast<std::uint32_t>(out.size() - 4));
+    out.replace(0, 4, length);
+    return out;
+}
+
+// `body` is the frame without its length prefix
+_EXPORT inline auto decode(std::string_view body) -> Frame
+{
+    Reader in { body };
+    Frame frame { static_cast<FrameType>(in.u8()) };
+    switch (frame.type) {
+    case FrameType::HELLO:
+        frame.node = in.string();
+        frame.payload = in.string();
+        break;
+    case FrameType::REGISTER:
+    case FrameType::UNREGISTER:
+        frame.from_user = in.string();
+        frame.node = in.string();
+        break;
+    case FrameType::ROUTE:
+        frame.from_user = in.string();
+        frame.from_node = in.string();
+        frame.to_user = in.string();
+        frame.to_node = in.string();
+        frame.msg.op = static_cast<OpCode>(in.u32());
+        frame.msg.data1 = in.string();
+        frame.msg.data2 = in.string();
+        break;
+    case FrameType::MIGRATE:
+    case FrameType::MIGRATED:
+        frame.node = in.string();
+        frame.from_user = in.string();
+        frame.payload = in.long_string();
+        break;
+    case FrameType::MIGRATE_INPUT:
+        frame.from_user = in.string();
+        frame.to_user = in.string();
+        frame.payload = in.long_string();
+        break;
+    default:
+        throw std::runtime_error("unknown cluster frame type");
+    }
+    return frame;
+}
+
+// Connections to the other nodes. Every node dials every peer and only writes
+// on the connections it dialed; accepted connections are only read. Frames for
+// a peer that is down wait in a bounded queue while the dialer retries.
+// An accepted connection is dropped unless its first frame is a HELLO from a
+// node of the config with the secret of the config.
+class Link {
+public:
+    // with the id of the node the frame came from
+    using Handler = std::function<void(const std::string& peer, Frame)>;
+
+    // accepts the other nodes on `acceptor`
+    Link(asio::io_context& io_context, const Config& config, std::string self, tcp::acceptor& acceptor, Handler handler)
+        : io_context_ { io_context }
+        , self_ { std::move(self) }
+        , secret_ { config.secret }
+        , handler_ { std::move(handler) }
+    {
+        if (secret_.empty())
+            throw std::invalid_argument("cluster: the config has no secret");
+        for (auto& node : config.nodes) {
+            if (node.id == self_)
+                continue;
+            auto peer { std::make_shared<Peer>(io_context_, node) };
+            peers_.emplace(node.id, peer);
+            co_spawn(io_context_, dial(peer), detached);
+        }
+        co_spawn(io_context_, listen(acceptor), detached);
+    }
+
+    // called with the id of a peer every time a connection to it is set up
+    void on_connected(std::function<void(const std::string&)> callback)
+    {
+        on_connected_ = std::move(callback);
+    }
+
+    void send(const std::string& node, const Frame& frame)
+    {
+        auto it { peers_.find(node) };
+        if (it == peers_.end()) {
+            logger->error("cluster: no peer {}", node);
+            return;
+        }
+        auto& peer { *it->second };
+        // only frames not yet handed to a write are dropped
+        if (peer.queue.size() >= max_queued_frames) {
+            logger->warn("cluster: queue to {} full, dropping a frame", node);
+            peer.queue.pop_front();
+        }
+        peer.queue.push_back(encode(frame));
+        peer.wake.cancel_one();
+    }
+
+private:
+    enum { max_queued_frames = 4096,
+        max_frame_size = 16 << 20,
+        max_hello_size = 4096 };
+
+    struct Peer {
+        Node node;
+        tcp::socket socket;
+        asio::steady_timer wake;
+        // frames waiting for the next write, and those of the write under
+        // way, which stay put until they are written
+        std::deque<std::string> queue, sending;
+        // counts the connections, so that a watch on an old one leaves the
+        // current one alone
+        unsigned generation {};
+
+        Peer(asio::io_context& io_context, Node node)
+            : node { std::move(node) }
+            , socket { io_context }
+            , wake { io_context }
+        {
+            wake.expires_at(std::chrono::steady_clock::time_point::max());
+        }
+    };
+
+    awaitable<void> dial(std::shared_ptr<Peer> peer)
+    {
+        tcp::resolver resolver { io_context_ };
+        for (;;) {
+            asio::error_code ec;
+            auto endpoints { co_await resolver.async_resolve(peer->node.host, std::to_string(peer->node.link_port), redirect_error(use_awaitable, ec)) };
+            if (!ec) {
+                peer->socket = tcp::socket { io_context_ };
+                co_await asio::async_connect(peer->socket, endpoints, redirect_error(use_awaitable, ec));
+            }
+            if (!ec) {
+                logger->info("cluster: linked to {}", peer->node.id);
+                peer->socket.set_option(tcp::no_delay { true });
+                peer->socket.set_option(tcp::socket::keep_alive { true });
+                co_spawn(io_context_, watch(peer, ++peer->generation), detached);
+                Frame hello { FrameType::HELLO, self_ };
+                hello.payload = secret_;
+                peer->sending.push_front(encode(hello));
+                if (on_connected_)
+                    on_connected_(peer->node.id);
+                co_await write_loop(*peer);
+                logger->warn("cluster: link to {} lost", peer->node.id);
+            }
+            asio::steady_timer backoff { io_context_, 500ms };
+            co_await backoff.async_wait(redirect_error(use_awaitable, ec));
+        }
+    }
+
+    // The peer never writes on a connection we dialed, so a read only ends
+    // when the connection does. Without it, a link to a peer that went away
+    // would only be found dead by the next write.
+    awaitable<void> watch(std::shared_ptr<Peer> peer, unsigned generation)
+    {
+        char byte;
+        asio::error_code ec;
+        co_await peer->socket.async_read_some(asio::buffer(&byte, 1), redirect_error(use_awaitable, ec));
+        if (peer->generation != generation)
+            co_return;
+        peer->socket.close(ec);
+        peer->wake.cancel_one();
+    }
+
+    awaitable<void> write_loop(Peer& peer)
+    {
+        asio::error_code ec;
+        while (!ec && peer.socket.is_open()) {
+            if (peer.sending.empty())
+                peer.sending.swap(peer.queue);
+            if (peer.sending.empty()) {
+                asio::error_code wait_ec;
+                co_await peer.wake.async_wait(redirect_error(use_awaitable, wait_ec));
+                continue;
+            }
+            // everything queued goes out in one write
+            std::vector<asio::const_buffer> buffers;
+            for (auto& frame : peer.sending)
+                buffers.push_back(asio::buffer(frame));
+            auto written { co_await asio::async_write(peer.socket, buffers, redirect_error(use_awaitable, ec)) };
+            // frames written in full are done with, a failed write included;
+            // one cut short goes again, whole, on the next connection
+            while (!peer.sending.empty() && written >= peer.sending.front().size()) {
+                written -= peer.sending.front().size();
+                peer.sending.pop_front();
+            }
+        }
+        peer.socket.close(ec);
+    }
+
+    awaitable<void> listen(tcp::acceptor& acceptor)
+    {
+        for (;;) {
+            asio::error_code ec;
+            auto socket { co_await acceptor.async_accept(redirect_error(use_awaitable, ec)) };
+            if (!acceptor.is_open())
+                co_return;
+            if (!ec)
+                co_spawn(io_context_, read_loop(std::move(socket)), detached);
+        }
+    }
+
+    awaitable<void> read_loop(tcp::socket socket)
+    {
+        std::string peer;
+        try {
+            std::string body;
+            for (;;) {
+                char prefix[4];
+                co_await asio::async_read(socket, asio::buffer(prefix), use_awaitable);
+                auto size { Reader { { prefix, 4 } }.u32() };
+                // nothing but a HELLO is read from a stranger
+                if (size > (peer.empty() ? max_hello_size : max_frame_size))
+                    throw std::runtime_error("cluster frame too large");
+                body.resize(size);
+                co_await asio::async_read(socket, asio::buffer(body), use_awaitable);
+                auto frame { decode(body) };
+                if (peer.empty()) {
+                    if (frame.type != FrameType::HELLO || !peers_.contains(frame.node) || !same_secret(frame.payload))
+                        throw std::runtime_error("not a node of the cluster");
+                    peer = frame.node;
+                } else if (frame.type == FrameType::HELLO)
+                    throw std::runtime_error("second HELLO");
+                // a frame the node fails on is not the fault of the link
+                try {
+                    handler_(peer, std::move(frame));
+                } catch (std::exception& e) {
+                    logger->error("cluster: {}", e.what());
+                }
+            }
+        } catch (std::exception& e) {
+            asio::error_code ec;
+            auto endpoint { socket.remote_endpoint(ec) };
+            if (peer.empty())
+                logger->warn("cluster: dropped a link from {}:{}: {}", endpoint.address().to_string(), endpoint.port(), e.what());
+            else
+                logger->debug("cluster: link from {} closed: {}", peer, e.what());
+        }
+    }
+
+    // in time independent of where the first difference is
+    auto same_secret(std::string_view secret) const -> bool
+    {
+        unsigned char diff { secret.size() != secret_.size() };
+        for (std::size_t i = 0; i < secret.size(); i++)
+            diff |= secret[i] ^ secret_[i % secret_.size()];
+        return !diff;
+    }
+
+    asio::io_context& io_context_;
+    std::string self_;
+    std::string secret_;
+    Handler handler_;
+    std::function<void(const std::string&)> on_connected_;
+    std::map<std::string, std::shared_ptr<Peer>> peers_;
+};
+
+class Cluster;
+
+// A player on another node, as seen by the room here. What the room delivers
+// to it is routed to that player's node, where it arrives from a proxy of
+// the local player.
+_EXPORT class ClusterParticipant : public Participant {
+public:
+    ClusterParticipant(Cluster& cluster, std::string user)
+        : cluster_ { cluster }
+        , user_ { std::move(user) }
+        , name_ { user_ }
+    {
+    }
+    std::string_view get_name() const override { return name_; }
+    void set_name(std::string_view name) override { name_ = name; }
+    tcp::endpoint endpoint() const override { return {}; }
+    void deliver(Message msg) override;
+    void stop() override { }
+    bool operator==(const Participant& participant) const override { return this == &participant; }
+
+    auto user() const -> const std::string& { return user_; }
+    // node of the player, empty until a message from it arrived
+    std::string node;
+
+private:
+    Cluster& cluster_;
+    // the name the player is registered under, whatever the room renames it to
+    std::string user_;
+    std::string name_;
+};
+
+// One node of the cluster: the directory shard of the names this node owns on
+// the ring, the players connected here, and the proxies of remote players.
+_EXPORT class Cluster {
+public:
+    // a message for the player `to`, connected to this node
+    using Handler = std::function<void(const std::string& to, std::shared_ptr<ClusterParticipant> from, Message)>;
+    // takes over a migrated room, returns why not if it can't
+    using MigrationHandler = std::function<std::string(std::string_view migration, std::string_view snapshot)>;
+    using InputHandler = std::function<void(std::string_view migration, std::string_view slot, Message)>;
+    // the node that took over the room, or nullptr with the reason it failed
+    using MigrationCallback = std::function<void(const Node*, std::string_view error)>;
+
+    // `link_acceptor` listens on the link port of this node
+    Cluster(asio::io_context& io_context, Config config, std::string self, tcp::acceptor& link_acceptor)
+        : io_context_ { io_context }
+        , config_ { std::move(config) }
+        , self_ { std::move(self) }
+        , link_ { io_context, config_, self_, link_acceptor, [this](const std::string& peer, Frame frame) {
+            if (authentic(peer, frame))
+                receive(std::move(frame));
+            else
+                logger->warn("cluster: {} sent a frame on behalf of another node", peer);
+        } }
+    {
+        for (auto& node : config_.nodes)
+            ring_.add(node.id);
+        link_.on_connected([this](const std::string& node) {
+            // the peer may have restarted and lost its directory shard
+            for (auto& user : users_)
+                if (ring_.owner(user) == node)
+                    link_.send(node, { FrameType::REGISTER, self_, user });
+        });
+        logger->info("cluster: node {} of {}", self_, config_.nodes.size());
+    }
+    Cluster(const Cluster&) = delete;
+
+    void set_handler(Handler handler) { handler_ = std::move(handler); }
+    void set_migration_handler(MigrationHandler handler, InputHandler input_handler)
+    {
+        migration_handler_ = std::move(handler);
+        input_handler_ = std::move(input_handler);
+    }
+    // name of the player the room's own messages are sent as
+    void set_local_name(std::function<std::string()> local_name) { local_name_ = std::move(local_name); }
+
+    auto self() const -> const std::string& { return self_; }
+    auto config() const -> const Config& { return config_; }
+
+    void register_user(const std::string& user)
+    {
+        if (!users_.insert(user).second)
+            return;
+        moved_.erase(user);
+        send_to_owner(user, { FrameType::REGISTER, self_, user });
+    }
+    void unregister_user(const std::string& user)
+    {
+        if (!users_.erase(user))
+            return;
+        send_to_owner(user, { FrameType::UNREGISTER, self_, user });
+    }
+
+    // The proxy of a player that is not connected here. It lives as long as
+    // the room holds it, as a participant or a player; private chat and the
+    // senders of routed messages the room doesn't keep leave nothing behind.
+    auto proxy(const std::string& user) -> std::shared_ptr<ClusterParticipant>
+    {
+        auto& entry { proxies_[user] };
+        if (auto proxy = entry.lock())
+            return proxy;
+        auto proxy { std::make_shared<ClusterParticipant>(*this, user) };
+        entry = proxy;
+        // forget the names whose proxies are gone once there are twice as
+        // many as were left after the last sweep
+        if (proxies_.size() >= sweep_proxies_at_) {
+            std::erase_if(proxies_, [](auto& it) { return it.second.expired(); });
+            sweep_proxies_at_ = std::max(2 * proxies_.size(), min_sweep_proxies);
+        }
+        return proxy;
+    }
+
+    void send(const ClusterParticipant& to, Message msg)
+    {
+        Frame frame { FrameType::ROUTE };
+        frame.from_user = local_name_ ? local_name_() : "";
+        frame.from_node = self_;
+        frame.to_user = to.user();
+        frame.to_node = to.node;
+        frame.msg = std::move(msg);
+        route(std::move(frame));
+    }
+
+    // Offers a room snapshot to the other nodes in config order until one
+    // takes it over. A node that doesn't answer within `timeout` is skipped.
+    void migrate(std::string migration, std::string snapshot, MigrationCallback callback, milliseconds timeout = 1s)
+    {
+        auto& pending { migrations_[migration] };
+        pending.snapshot = std::move(snapshot);
+        pending.callback = std::move(callback);
+        pending.timer = std::make_unique<asio::steady_timer>(io_context_);
+        pending.timeout = timeout;
+        offer(migration);
+    }
+
+    // input for a room that was migrated to `node`
+    void send_input(const std::string& node, std::string migration, std::string slot, Message msg)
+    {
+        Frame frame { FrameType::MIGRATE_INPUT };
+        frame.from_user = std::move(migration);
+        frame.to_user = std::move(slot);
+        frame.payload = msg.to_string();
+        link_.send(node, frame);
+    }
+
+    // keep forwarding what is routed to `user` here, for peers that still
+    // have this node as its address
+    void moved(const std::string& user, const std::string& node)
+    {
+        moved_[user] = node;
+    }
+
+private:
+    struct Migration {
+        std::string snapshot;
+        MigrationCallback callback;
+        std::unique_ptr<asio::steady_timer> timer;
+        milliseconds timeout;
+        std::size_t next {};
+    };
+
+    void offer(const std::string& migration)
+    {
+        auto it { migrations_.find(migration) };
+        if (it == migrations_.end())
+            return;
+        auto& pending { it->second };
+        while (pending.next < config_.nodes.size() && config_.nodes[pending.next].id == self_)
+            pending.next++;
+        if (pending.next == config_.nodes.size()) {
+            auto callback { std::move(pending.callback) };
+            migrations_.erase(it);
+            callback(nullptr, "no node took over the room");
+            return;
+        }
+        auto& node { config_.nodes[pending.next++] };
+        logger->info("cluster: offering room {} to {}", migration, node.id);
+        Frame frame { FrameType::MIGRATE, self_, migration };
+        frame.payload = pending.snapshot;
+        link_.send(node.id, frame);
+        pending.timer->expires_after(pending.timeout);
+        pending.timer->async_wait([this, migration](const asio::error_code& ec) {
+            if (!ec)
+                offer(migration);
+        });
+    }
+
+    void migrated(const Frame& frame)
+    {
+        auto it { migrations_.find(frame.from_user) };
+        if (it == migrations_.end() || config_.nodes[it->second.next - 1].id != frame.node)
+            return;
+        if (!frame.payload.empty()) {
+            logger->info("cluster: {} refused room {}: {}", frame.node, frame.from_user, frame.payload);
+            offer(frame.from_user);
+            return;
+        }
+        auto callback { std::move(it->second.callback) };
+        migrations_.erase(it);
+        callback(&config_.node(frame.node), "");
+    }
+
+    void send_to_owner(const std::string& user, Frame frame)
+    {
+        if (auto& owner = ring_.owner(user); owner == self_)
+            receive(std::move(frame));
+        else
+            link_.send(owner, frame);
+    }
+
+    void route(Frame frame)
+    {
+        if (frame.to_node == self_)
+            if (auto it = moved_.find(frame.to_user); it != moved_.end())
+                frame.to_node = it->second;
+        auto& next { frame.to_node.empty() ? ring_.owner(frame.to_user) : frame.to_node };
+        if (next == self_)
+            receive(std::move(frame));
+        else
+            link_.send(next, frame);
+    }
+
+    // Frames a node sends for itself must name it. A ROUTE may come through
+    // the owner of the recipient's name, or the node it moved from, so its
+    // sender only has to be a node of the cluster; input for a migrated room
+    // only comes from the node that handed the room over.
+    auto authentic(const std::string& peer, const Frame& frame) const -> bool
+    {
+        switch (frame.type) {
+        case FrameType::HELLO:
+        case FrameType::REGISTER:
+        case FrameType::UNREGISTER:
+        case FrameType::MIGRATE:
+        case FrameType::MIGRATED:
+            return frame.node == peer;
+        case FrameType::ROUTE:
+            return std::ranges::any_of(config_.nodes, [&](auto& node) { return node.id == frame.from_node; });
+        case FrameType::MIGRATE_INPUT: {
+            auto it { migrated_from_.find(frame.from_user) };
+            return it != migrated_from_.end() && it->second == peer;
+        }
+        }
+        return false;
+    }
+
+    void receive(Frame frame)
+    {
+        switch (frame.type) {
+        case FrameType::HELLO:
+            logger->info("cluster: {} linked to us", frame.node);
+            break;
+        case FrameType::REGISTER:
+            directory_[frame.from_user] = frame.node;
+            break;
+        case FrameType::UNREGISTER:
+            if (auto it = directory_.find(frame.from_user); it != directory_.end() && it->second == frame.node)
+                directory_.erase(it);
+            break;
+        case FrameType::ROUTE:
+            if (frame.to_node.empty()) {
+                // we own the name, look up where the player is
+                auto it { directory_.find(frame.to_user) };
+                if (it == directory_.end()) {
+                    logger->info("cluster: {} is not online", frame.to_user);
+                    if (frame.msg.op == OpCode::READY_OP)
+                        bounce(frame);
+                    return;
+                }
+                frame.to_node = it->second;
+                route(std::move(frame));
+            } else if (frame.to_node != self_ || moved_.contains(frame.to_user)) {
+                route(std::move(frame));
+            } else if (handler_) {
+                auto from { proxy(frame.from_user) };
+                from->node = frame.from_node;
+                handler_(frame.to_user, from, std::move(frame.msg));
+            }
+            break;
+        case FrameType::MIGRATE: {
+            Frame reply { FrameType::MIGRATED, self_, frame.from_user };
+            reply.payload = migration_handler_ ? migration_handler_(frame.from_user, frame.payload) : "migration is not supported";
+            if (reply.payload.empty())
+                migrated_from_[frame.from_user] = frame.node;
+            link_.send(frame.node, reply);
+            break;
+        }
+        case FrameType::MIGRATED:
+            migrated(frame);
+            break;
+        case FrameType::MIGRATE_INPUT:
+            if (input_handler_)
+                input_handler_(frame.from_user, frame.to_user, Message { frame.payload });
+            break;
+        }
+    }
+
+    // answer a request for a player that is offline with a rejection
+    void bounce(const Frame& frame)
+    {
+        Frame reply { FrameType::ROUTE };
+        reply.from_user = frame.to_user;
+        reply.from_node = self_;
+        reply.to_user = frame.from_user;
+        reply.to_node = frame.from_node;
+        reply.msg = { OpCode::REJECT_OP, frame.to_user };
+        route(std::move(reply));
+    }
+
+    asio::io_context& io_context_;
+    Config config_;
+    std::string self_;
+    HashRing ring_;
+    Link link_;
+    Handler handler_;
+    MigrationHandler migration_handler_;
+    InputHandler input_handler_;
+    std::map<std::string, Migration> migrations_;
+    std::map<std::string, std::string> moved_;
+    // node every room taken over here came from, by migration
+    std::map<std::string, std::string> migrated_from_;
+    std::function<std::string()> local_name_;
+    // players connected here
+    std::set<std::string> users_;
+    // node of every player whose name this node owns on the ring
+    std::map<std::string, std::string> directory_;
+    static constexpr std::size_t min_sweep_proxies { 64 };
+    std::map<std::string, std::weak_ptr<ClusterParticipant>> proxies_;
+    std::size_t sweep_proxies_at_ { min_sweep_proxies };
+};
+
+inline void ClusterParticipant::deliver(Message msg)
+{
+    cluster_.send(*this, std::move(msg));
+}
+
+}
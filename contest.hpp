@@ -4,9 +4,13 @@
 #endif
 
 #include <algorithm>
+#include <array>
 #include <cctype>
 #include <chrono>
+#include <cstddef>
+#include <memory_resource>
 #include <ranges>
+#include <span>
 #include <stdexcept>
 #include <utility>
 #include <vector>
@@ -14,7 +18,7 @@
 #ifdef __GNUC__
 #include <range/v3/all.hpp>
 namespace ranges::views {
-auto join_with = join;
+inline auto join_with = join;
 };
 #else
 namespace ranges = std::ranges;
@@ -42,8 +46,24 @@ public:
     virtual void set_name(std::string_view name) = 0;
     virtual tcp::endpoint endpoint() const = 0;
     virtual void deliver(Message msg) = 0;
+    // messages serialized in advance, e.g. chat history; sessions send them
+    // in one write
+    virtual void deliver_encoded(std::span<const std::string_view> msgs)
+    {
+        for (auto msg : msgs)
+            deliver(Message { msg });
+    }
+    // a message published to a topic, with its text: sessions send the
+    // text, the others take the message as it is
+    virtual void deliver_published(const Message& msg, [[maybe_unused]] std::string_view encoded)
+    {
+        deliver(msg);
+    }
     virtual void stop() = 0;
     virtual bool operator==(const Participant&) const = 0;
+    // whether the room sends it the lobby when it joins, rather than when
+    // it subscribes
+    virtual bool lobby_on_join() const { return false; }
 
     auto to_string() const
     {
@@ -80,9 +100,14 @@ _EXPORT struct Player {
 };
 
 class PlayerList {
-    std::vector<Player> players;
+    std::pmr::vector<Player> players;
 
 public:
+    explicit PlayerList(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : players { resource }
+    {
+    }
+
     auto find(Role role, Participant_ptr participant = nullptr)
     {
         // If the criteria is valid, the player must match it
@@ -145,9 +170,27 @@ public:
     {
         return players.size();
     }
+    void clear()
+    {
+        players.clear();
+    }
+    // the same players, played by someone else from now on
+    void rebind(const Participant_ptr& from, const Participant_ptr& to)
+    {
+        for (auto& player : players)
+            if (player.participant == from)
+                player.participant = to;
+    }
 };
 
 _EXPORT class Contest {
+    // The game data of a contest lives in an arena it owns: a whole game fits,
+    // so it never reaches the global heap, and `clear()` rewinds the arena
+    // instead of freeing element by element.
+    enum { arena_size = 2048 };
+    alignas(std::max_align_t) std::array<std::byte, arena_size> arena_;
+    std::pmr::monotonic_buffer_resource resource_ { arena_.data(), arena_.size() };
+
 public:
     enum class Status {
         NOT_PREPARED,
@@ -175,8 +218,8 @@ public:
     bool should_giveup {};
 
     State current {};
-    std::vector<Position> moves;
-    PlayerList players;
+    std::pmr::vector<Point> moves { &resource_ };
+    PlayerList players { &resource_ };
 
     Status status {};
     GameResult result {};
@@ -185,11 +228,19 @@ public:
     std::chrono::system_clock::time_point end_time;
     Role local_role { Role::NONE };
 
+    Contest()
+    {
+        moves.reserve(rank_n * rank_n);
+    }
+    Contest(const Contest&) = delete;
+
     void clear()
     {
         current = {};
-        moves.clear();
-        players = {};
+        moves = std::pmr::vector<Point> { &resource_ };
+        players = PlayerList { &resource_ };
+        resource_.release();
+        moves.reserve(rank_n * rank_n);
         status = {};
         result = {};
         should_giveup = false;
@@ -205,7 +256,7 @@ public:
             logger->critical("Reject: Contest stautus is {}", std::to_underlying(status));
             throw std::logic_error("Contest already started");
         }
-        players = {};
+        players.clear();
     }
 
     void enroll(Player&& player)
@@ -221,7 +272,7 @@ public:
         }
     }
 
-    void play(Player player, Position pos)
+    void play(Player player, Point pos)
     {
         if (status != Status::ON_GOING) {
             logger->critical("Play: Contest stautus is {}", std::to_underlying(status));
@@ -232,11 +283,11 @@ public:
             throw std::logic_error(player.name + " not allowed to play");
         }
         if (current.board[pos]) {
-            logger->critical("Play: positon ({},{}) is occupied", pos.x, pos.y);
+            logger->critical("Play: positon ({},{}) is occupied", pos.x(), pos.y());
             throw StonePositionitionOccupiedException("Stone positionition occupied");
         }
-        std::cout << "contest play " << pos.x << ", " << pos.y << std::endl;
-        logger->info("contest play " + std::to_string(pos.x) + ", " + std::to_string(pos.y));
+        std::cout << "contest play " << pos.x() << ", " << pos.y() << std::endl;
+        logger->info("contest play " + std::to_string(pos.x()) + ", " + std::to_string(pos.y()));
         current = current.next_state(pos);
         moves.push_back(pos);
 
@@ -0,0 +1,204 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <asio/awaitable.hpp>
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/use_awaitable.hpp>
+#include <asio/write.hpp>
+
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "log.hpp"
+
+using asio::awaitable;
+using asio::co_spawn;
+using asio::detached;
+using asio::redirect_error;
+using asio::use_awaitable;
+using asio::ip::tcp;
+using nlohmann::json;
+
+// The latest value of a resource owned by another thread, e.g. the room on
+// the game thread: the owner publishes whole snapshots and the API renders
+// them, never touching the owner's state.
+_EXPORT template <typename T>
+class Snapshot {
+public:
+    void publish(T value)
+    {
+        auto next { std::make_shared<const T>(std::move(value)) };
+        std::lock_guard lock { mutex_ };
+        value_ = std::move(next);
+        version_++;
+    }
+    auto get() const -> std::shared_ptr<const T>
+    {
+        std::lock_guard lock { mutex_ };
+        return value_;
+    }
+    auto version() const -> std::uint64_t { return version_.load(); }
+
+private:
+    mutable std::mutex mutex_;
+    std::shared_ptr<const T> value_;
+    std::atomic<std::uint64_t> version_ {};
+};
+
+// Read-only HTTP/1.1 API for dashboards. Every route renders JSON from an
+// in-memory index; the complete response is cached per target and only
+// rebuilt when the version of its source changes, so polling is a map lookup.
+_EXPORT class HttpApi {
+public:
+    using Version = std::function<std::uint64_t()>;
+    // receives the path below the route prefix and the `page` query parameter
+    using Render = std::function<std::optional<json>(std::string_view, std::size_t)>;
+
+    void route(std::string prefix, Version version, Render render)
+    {
+        routes_.push_back({ std::move(prefix), std::move(version), std::move(render) });
+    }
+
+    auto respond(std::string_view target) -> std::shared_ptr<const std::string>
+    {
+        auto path { target.substr(0, target.find('?')) };
+        for (auto& route : routes_) {
+            if (!path.starts_with(route.prefix))
+                continue;
+            auto rest { path.substr(route.prefix.size()) };
+            if (!rest.empty() && rest[0] != '/')
+                continue;
+
+            auto version { route.version() };
+            if (auto it = cache_.find(target); it != cache_.end() && it->second.first == version)
+                return it->second.second;
+
+            auto body { route.render(rest, page(target)) };
+            auto response = body ? make_response("200 OK", body->dump()) : not_found();
+            if (cache_.size() >= max_cache_entries)
+                cache_.clear();
+            cache_[std::string { target }] = { version, response };
+            return response;
+        }
+        return not_found();
+    }
+
+    static auto make_response(std::string_view status, std::string_view body) -> std::shared_ptr<const std::string>
+    {
+        return std::make_shared<const std::string>(
+            "HTTP/1.1 " + std::string { status } + "\r\nContent-Type: application/json\r\nContent-Length: "
+            + std::to_string(body.size()) + "\r\n\r\n" + std::string { body });
+    }
+
+private:
+    enum { max_cache_entries = 1024 };
+
+    struct Route {
+        std::string prefix;
+        Version version;
+        Render render;
+    };
+
+    // the value of the `page` key of the query, not of keys ending in page
+    static std::size_t page(std::string_view target)
+    {
+        if (target.find('?') == target.npos)
+            return 0;
+        for (auto param : target.substr(target.find('?') + 1) | std::views::split('&')) {
+            std::string_view sv { param.begin(), param.end() };
+            if (!sv.starts_with("page="))
+                continue;
+            std::size_t res {};
+            std::from_chars(sv.data() + 5, sv.data() + sv.size(), res);
+            return res;
+        }
+        return 0;
+    }
+
+    static auto not_found() -> std::shared_ptr<const std::string>
+    {
+        static auto response { make_response("404 Not Found", R"({"error":"not found"})") };
+        return response;
+    }
+
+    std::vector<Route> routes_;
+    std::map<std::string, std::pair<std::uint64_t, std::shared_ptr<const std::string>>, std::less<>> cache_;
+};
+
+// One keep-alive connection. Pipelined requests that arrive together are
+// answered with a single gathered write, in order.
+inline awaitable<void> http_session(tcp::socket socket, HttpApi& api)
+{
+    enum { max_request_size = 8192 };
+    try {
+        std::string buffer;
+        for (bool keep_alive = true; keep_alive;) {
+            std::size_t n = buffer.size();
+            buffer.resize(n + 4096);
+            buffer.resize(n + co_await socket.async_read_some(asio::buffer(buffer.data() + n, 4096), use_awaitable));
+
+            std::vector<std::shared_ptr<const std::string>> responses;
+            for (std::size_t end; keep_alive && (end = buffer.find("\r\n\r\n")) != buffer.npos;) {
+                std::string_view request { buffer.data(), end };
+                auto line { request.substr(0, request.find("\r\n")) };
+                auto method { line.substr(0, line.find(' ')) };
+                auto target { line.substr(method.size() + 1) };
+                target = target.substr(0, target.find(' '));
+
+                auto has_header = [&](std::string_view header) {
+                    return request.find(header) != request.npos;
+                };
+                keep_alive = line.ends_with("HTTP/1.1") ? !has_header("Connection: close") && !has_header("connection: close")
+                                                        : has_header("Connection: keep-alive");
+                if (method == "GET") {
+                    responses.push_back(api.respond(target));
+                } else {
+                    // request bodies are not parsed, so stop reading this connection
+                    responses.push_back(HttpApi::make_response("405 Method Not Allowed", R"({"error":"read only"})"));
+                    keep_alive = false;
+                }
+                buffer.erase(0, end + 4);
+            }
+            if (buffer.size() > max_request_size)
+                throw std::runtime_error("http: request too large");
+
+            std::vector<asio::const_buffer> buffers;
+            for (auto& response : responses)
+                buffers.push_back(asio::buffer(*response));
+            co_await asio::async_write(socket, buffers, use_awaitable);
+        }
+        asio::error_code ec;
+        socket.shutdown(tcp::socket::shutdown_both, ec);
+    } catch (std::exception& e) {
+        logger->debug("http_session: {}", e.what());
+    }
+}
+
+// runs until `acceptor` is closed
+inline awaitable<void> http_listener(tcp::acceptor& acceptor, HttpApi& api)
+{
+    for (;;) {
+        asio::error_code ec;
+        auto socket { co_await acceptor.async_accept(redirect_error(use_awaitable, ec)) };
+        if (!acceptor.is_open())
+            co_return;
+        if (!ec)
+            co_spawn(acceptor.get_executor(), http_session(std::move(socket), api), detached);
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <asio/any_io_executor.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "contest.hpp"
+#include "message.hpp"
+#include "pubsub.hpp"
+
+using nlohmann::json;
+
+_EXPORT enum class PresenceStatus {
+    IDLE,
+    IN_GAME,
+    QUEUED,
+};
+
+// Online players and their status. Subscribers get the whole list once and
+// then one LOBBY_UPDATE_OP per tick carrying only what changed since the last
+// one: a player who came and went within a tick is never announced, and a
+// status flipping back and forth only shows up if it ended different. The
+// cost of a tick is the number of changed players, not the number online.
+// Players are known by an id the room gives each participant, so that two of
+// them under the same name are both listed and a rename is an update, not a
+// player leaving. Updates go out on the "lobby" topic.
+_EXPORT class Lobby {
+public:
+    static constexpr std::string_view topic { "lobby" };
+    using Id = std::uint64_t;
+
+    Lobby(asio::any_io_executor executor, TopicHub& topics, std::chrono::milliseconds tick = std::chrono::milliseconds { 200 })
+        : timer_ { executor }
+        , tick_ { tick }
+        , topics_ { topics }
+    {
+    }
+
+    void set(Id id, std::string_view name, PresenceStatus status)
+    {
+        if (auto [it, inserted] = current_.try_emplace(id, Presence { std::string { name }, status }); !inserted) {
+            if (it->second.name == name && it->second.status == status)
+                return;
+            it->second = { std::string { name }, status };
+        }
+        mark(id);
+    }
+    void erase(Id id)
+    {
+        if (current_.erase(id))
+            mark(id);
+    }
+
+    void subscribe(Participant_ptr participant)
+    {
+        topics_.subscribe(std::string { topic }, participant);
+        json players = json::array();
+        for (auto& [id, presence] : published_)
+            players.push_back({ { "id", id }, { "name", presence.name }, { "status", presence.status } });
+        participant->deliver({ OpCode::LOBBY_SNAPSHOT_OP, players.dump() });
+    }
+    void unsubscribe(const Participant_ptr& participant)
+    {
+        topics_.unsubscribe(topic, participant);
+    }
+
+    auto size() const { return current_.size(); }
+
+private:
+    struct Presence {
+        std::string name;
+        PresenceStatus status;
+
+        bool operator==(const Presence&) const = default;
+    };
+
+    void mark(Id id)
+    {
+        dirty_.insert(id);
+        if (scheduled_)
+            return;
+        scheduled_ = true;
+        timer_.expires_after(tick_);
+        timer_.async_wait([this](const asio::error_code& ec) {
+            if (!ec)
+                flush();
+        });
+    }
+
+    void flush()
+    {
+        scheduled_ = false;
+        json changes = json::array();
+        for (auto id : dirty_) {
+            auto now { current_.find(id) };
+            auto before { published_.find(id) };
+            if (now == current_.end()) {
+                if (before != published_.end()) {
+                    changes.push_back({ { "id", id }, { "event", "remove" } });
+                    published_.erase(before);
+                }
+            } else if (before == published_.end()) {
+                changes.push_back({ { "id", id }, { "event", "add" }, { "name", now->second.name }, { "status", now->second.status } });
+                published_.emplace(id, now->second);
+            } else if (before->second != now->second) {
+                changes.push_back({ { "id", id }, { "event", "update" }, { "name", now->second.name }, { "status", now->second.status } });
+                before->second = now->second;
+            }
+        }
+        dirty_.clear();
+        if (!changes.empty() && topics_.subscribers(topic))
+            topics_.publish(topic, { OpCode::LOBBY_UPDATE_OP, changes.dump() });
+    }
+
+    asio::steady_timer timer_;
+    std::chrono::milliseconds tick_;
+    bool scheduled_ {};
+    std::unordered_map<Id, Presence> current_, published_;
+    std::unordered_set<Id> dirty_;
+    TopicHub& topics_;
+};
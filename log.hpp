@@ -9,8 +9,8 @@
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/sinks/basic_file_sink.h"
 
-std::optional<spdlog::logger> logger;
-void init_log(){
+inline std::optional<spdlog::logger> logger;
+inline void init_log(){
     auto console_sink = std::make_shared<spdlog::sinks::ansicolor_stdout_sink_mt>();
     console_sink->set_level(spdlog::level::info);
     auto trace_sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>("./logs/trace_log", true);
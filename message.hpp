@@ -42,6 +42,21 @@ _EXPORT enum class OpCode : int {
     ACCEPT_REQUEST_OP,
     REJECT_REQUEST_OP,
     RECEIVE_REQUEST_RESULT_OP,
+    // -------- Bot --------
+    BOT_MOVE_OP,
+    // -------- Lobby --------
+    LOBBY_SUBSCRIBE_OP,
+    LOBBY_UNSUBSCRIBE_OP,
+    LOBBY_SNAPSHOT_OP,
+    LOBBY_UPDATE_OP,
+    // -------- Topic --------
+    TOPIC_SUBSCRIBE_OP,
+    TOPIC_UNSUBSCRIBE_OP,
+    TOPIC_PUBLISH_OP,
+    TOPIC_MESSAGE_OP,
+    // -------- Migration --------
+    REDIRECT_OP,
+    RESUME_OP,
     // -------- Extend OpCode End --------
 };
 
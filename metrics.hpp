@@ -0,0 +1,53 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+
+using nlohmann::json;
+
+// Process-wide named values, written by subsystems and read by the HTTP API
+_EXPORT class MetricsRegistry {
+public:
+    void set(std::string_view name, double value)
+    {
+        std::lock_guard lock { mutex_ };
+        values_[std::string { name }] = value;
+        version_++;
+    }
+    void add(std::string_view name, double delta)
+    {
+        std::lock_guard lock { mutex_ };
+        values_[std::string { name }] += delta;
+        version_++;
+    }
+    auto get(std::string_view name) const -> double
+    {
+        std::lock_guard lock { mutex_ };
+        auto it = values_.find(name);
+        return it == values_.end() ? 0 : it->second;
+    }
+    auto snapshot() const -> json
+    {
+        std::lock_guard lock { mutex_ };
+        json res = json::object();
+        for (auto& [name, value] : values_)
+            res[name] = value;
+        return res;
+    }
+    auto version() const { return version_.load(); }
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, double, std::less<>> values_;
+    std::atomic<std::uint64_t> version_ {};
+};
+
+_EXPORT inline MetricsRegistry metrics;
@@ -0,0 +1,111 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "contest.hpp"
+#include "message.hpp"
+
+using nlohmann::json;
+
+// Moving a room to another node: the room is frozen and written out as JSON,
+// with every participant replaced by a slot. Players connected directly get
+// a resume token as their slot; they are redirected to the new node and
+// claim it back with RESUME_OP. Until they do, a ResumeParticipant stands in
+// for them there and keeps what the room sends them.
+namespace migration {
+
+// unguessable, a token is all it takes to take over a seat
+_EXPORT inline auto make_token() -> std::string
+{
+    static thread_local std::mt19937_64 rng { std::random_device {}() };
+    static constexpr char digits[] { "0123456789abcdef" };
+    std::string token(32, '0');
+    std::uint64_t bits {};
+    for (std::size_t i = 0; i < token.size(); i++, bits >>= 4) {
+        if (i % 16 == 0)
+            bits = rng();
+        token[i] = digits[bits & 0xf];
+    }
+    return token;
+}
+
+_EXPORT class ResumeParticipant : public Participant {
+public:
+    ResumeParticipant(std::string token, std::string name, bool is_local)
+        : Participant { is_local }
+        , token { std::move(token) }
+        , name_ { std::move(name) }
+    {
+    }
+    std::string_view get_name() const override { return name_; }
+    void set_name(std::string_view name) override { name_ = name; }
+    tcp::endpoint endpoint() const override { return {}; }
+    void deliver(Message msg) override { pending.push_back(std::move(msg)); }
+    void stop() override { }
+    bool operator==(const Participant& participant) const override { return this == &participant; }
+
+    const std::string token;
+    std::vector<Message> pending;
+
+private:
+    std::string name_;
+};
+
+inline auto to_ms(std::chrono::system_clock::time_point tp)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count();
+}
+
+// `slot_of` names the slot of a participant
+_EXPORT inline auto save_contest(const Contest& contest, const std::function<std::string(const Participant_ptr&)>& slot_of) -> json
+{
+    json players = json::array();
+    for (auto role : { Role::BLACK, Role::WHITE })
+        if (auto player = contest.players.find(role))
+            players.push_back({ { "slot", slot_of(player->participant) }, { "name", player->name }, { "role", role.map("b", "w", "") }, { "type", player->type } });
+    json moves = json::array();
+    for (auto pos : contest.moves)
+        moves.push_back(pos.to_string());
+    return {
+        { "status", contest.status },
+        { "players", players },
+        { "moves", moves },
+        { "result", { { "winner", contest.result.winner.map("b", "w", "") }, { "win_type", contest.result.win_type }, { "confirmed", contest.result.confirmed } } },
+        { "should_giveup", contest.should_giveup },
+        { "duration", contest.duration.count() },
+        { "start_time", to_ms(contest.start_time) },
+        { "end_time", to_ms(contest.end_time) },
+        { "local_role", contest.local_role.map("b", "w", "") },
+    };
+}
+
+// `contest` must be cleared; `participant_of` looks a slot up
+_EXPORT inline void restore_contest(Contest& contest, const json& saved, const std::function<Participant_ptr(const std::string&)>& participant_of)
+{
+    using std::chrono::milliseconds;
+    for (auto& player : saved["players"])
+        contest.enroll({ participant_of(player["slot"]), player["name"].get<std::string>(), Role { player["role"].get<std::string>() }, player["type"].get<PlayerType>() });
+    // replaying the moves rebuilds the board, then the rest is taken as saved
+    for (auto& pos : saved["moves"])
+        contest.play(contest.players.at(contest.current.role), Point { pos.get<std::string>() });
+    contest.status = saved["status"];
+    auto& result { saved["result"] };
+    contest.result = { Role { result["winner"].get<std::string>() }, result["win_type"], result["confirmed"] };
+    contest.should_giveup = saved["should_giveup"];
+    contest.duration = std::chrono::seconds { saved["duration"].get<long long>() };
+    contest.start_time = std::chrono::system_clock::time_point { milliseconds { saved["start_time"].get<long long>() } };
+    contest.end_time = std::chrono::system_clock::time_point { milliseconds { saved["end_time"].get<long long>() } };
+    contest.local_role = Role { saved["local_role"].get<std::string>() };
+}
+
+}
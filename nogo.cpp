@@ -14,13 +14,56 @@ auto main(int argc, char* argv[]) -> int
     init_log();
     for (int i = 0; i < argc; i++)
         logger->info("argv[{}]: {}", i, argv[i]);
-    if (argc < 2) {
-        std::cerr << "Usage: server <port> [<port> ...]\n";
-        logger->error("Usage: server <port> [<port> ...]\n");
+
+    ServerOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg { argv[i] };
+        if (!arg.starts_with("--")) {
+            options.ports.push_back(std::atoi(argv[i]));
+            continue;
+        }
+        if (i + 1 == argc)
+            break;
+        std::string_view value { argv[++i] };
+        if (arg == "--local-socket")
+            options.local_socket = value;
+        else if (arg == "--websocket-port")
+            options.websocket_port = stoi(value);
+        else if (arg == "--http-port")
+            options.http_port = stoi(value);
+        else if (arg == "--trace")
+            options.trace_file = value;
+        else if (arg == "--chat-log")
+            options.chat_log = value;
+        else if (arg == "--cluster")
+            options.cluster_config = value;
+        else if (arg == "--node")
+            options.node_id = value;
+        else if (arg == "--upgrade-socket")
+            options.upgrade_socket = value;
+        else if (arg == "--takeover")
+            options.takeover = value;
+#ifdef NOGO_HAS_BOT_WORKERS
+        else if (arg == "--bot-workers")
+            options.bot.workers = stoi(value);
+        else if (arg == "--bot-worker-path")
+            options.bot.worker_path = value;
+        else if (arg == "--bot-threads")
+            options.bot.threads = stoi(value);
+        else if (arg == "--bot-max-memory")
+            options.bot.max_memory = stoi(value);
+        else if (arg == "--bot-pin")
+            options.bot.pin_threads = value != "0";
+        else if (arg == "--bot-cpus") {
+            options.bot.pin_threads = true;
+            options.bot.cpus = botproto::parse_cpus(value);
+        }
+#endif
+    }
+    if (options.ports.empty()) {
+        std::cerr << "Usage: server <port> [<port> ...] [--<option> <value> ...]\n";
+        logger->error("Usage: server <port> [<port> ...] [--<option> <value> ...]\n");
         return 1;
     }
-    auto ports = std::ranges::subrange(argv + 1, argv + argc)
-        | std::views::transform([](auto s) -> unsigned short { return std::atoi(s); })
-        | ranges::to<std::vector>();
-    launch_server(ports);
+    launch_server(options);
 }
\ No newline at end of file
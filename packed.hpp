@@ -0,0 +1,122 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NOGO_PACKED_SSE2
+#endif
+
+#include "rule.hpp"
+
+// The canonical compact form of a position: 2 bits per point, row-major as
+// Board::index(), with the side to move in the spare bits of the last byte.
+// 9x9 fits in 21 bytes, against 81 for a Board. A point is the low two bits
+// of its Role id, so empty is 00, black 01 and white 11.
+namespace packed {
+
+constexpr std::size_t points = rank_n * rank_n;
+constexpr std::size_t side_byte = points / 4, side_shift = points % 4 * 2;
+constexpr std::size_t size = (points * 2 + 2 + 7) / 8;
+static_assert(side_byte < size);
+
+_EXPORT struct PackedState {
+    std::array<std::uint8_t, size> bytes {};
+
+    constexpr bool operator==(const PackedState&) const = default;
+    auto view() const { return std::string_view { reinterpret_cast<const char*>(bytes.data()), bytes.size() }; }
+};
+
+constexpr auto to_role(unsigned code)
+{
+    return code == 1 ? Role::BLACK : code == 3 ? Role::WHITE
+                                               : Role::NONE;
+}
+
+// the four points of every byte
+inline constexpr auto unpack_table = [] {
+    std::array<std::array<Role, 4>, 256> res {};
+    for (unsigned byte = 0; byte < 256; byte++)
+        for (unsigned k = 0; k < 4; k++)
+            res[byte][k] = to_role(byte >> (k * 2) & 3);
+    return res;
+}();
+
+// the points from `from` on, one at a time
+inline void pack_points(const Board& board, std::size_t from, PackedState& res)
+{
+    auto& cells { board.cells() };
+    for (auto i { from }; i < cells.size(); i++)
+        res.bytes[i / 4] |= (cells[i].id & 3) << (i % 4 * 2);
+}
+
+// pack() without SSE2, which the tests hold the SSE2 path to
+_EXPORT inline auto pack_scalar(const Board& board, Role to_move) -> PackedState
+{
+    PackedState res;
+    pack_points(board, 0, res);
+    res.bytes[side_byte] |= (to_move.id & 3) << side_shift;
+    return res;
+}
+
+_EXPORT inline auto pack(const Board& board, Role to_move) -> PackedState
+{
+    PackedState res;
+    [[maybe_unused]] auto& cells { board.cells() };
+    std::size_t i {};
+#ifdef NOGO_PACKED_SSE2
+    static_assert(sizeof(Role) == 1);
+    // 16 points at a time: the ids are masked to their codes, then every four
+    // bytes are folded into one
+    const auto code_mask { _mm_set1_epi8(3) }, byte_mask { _mm_set1_epi32(0xff) };
+    for (; i + 16 <= cells.size(); i += 16) {
+        auto codes { _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&cells[i])), code_mask) };
+        auto folded { _mm_or_si128(_mm_or_si128(codes, _mm_srli_epi32(codes, 6)), _mm_or_si128(_mm_srli_epi32(codes, 12), _mm_srli_epi32(codes, 18))) };
+        folded = _mm_and_si128(folded, byte_mask);
+        folded = _mm_packus_epi16(_mm_packs_epi32(folded, folded), folded);
+        auto word { static_cast<std::uint32_t>(_mm_cvtsi128_si32(folded)) };
+        std::memcpy(&res.bytes[i / 4], &word, sizeof(word));
+    }
+#endif
+    pack_points(board, i, res);
+    res.bytes[side_byte] |= (to_move.id & 3) << side_shift;
+    return res;
+}
+
+_EXPORT inline auto pack(const State& state)
+{
+    return pack(state.board, state.role);
+}
+
+// the board and the side to move
+_EXPORT inline auto unpack(const PackedState& packed) -> std::pair<Board, Role>
+{
+    Board board {};
+    auto& cells { board.cells() };
+    std::size_t i {};
+    // a lookup and a 4-byte copy per byte
+    for (; i + 4 <= cells.size(); i += 4)
+        std::memcpy(&cells[i], unpack_table[packed.bytes[i / 4]].data(), sizeof(Role) * 4);
+    for (; i < cells.size(); i++)
+        cells[i] = to_role(packed.bytes[i / 4] >> (i % 4 * 2) & 3);
+    return { board, to_role(packed.bytes[side_byte] >> side_shift & 3) };
+}
+
+}
+
+template <>
+struct std::hash<packed::PackedState> {
+    auto operator()(const packed::PackedState& state) const noexcept -> std::size_t
+    {
+        return std::hash<std::string_view> {}(state.view());
+    }
+};
@@ -0,0 +1,40 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+// Memory recycled across connections. Sessions, their write queues and read
+// buffers are carved from one pool: blocks of a closed connection go back to
+// the pool's free lists and serve the next accept, and the first chunks come
+// from a region allocated up front. The pool is unsynchronized, so every
+// session made from it must be created and destroyed on the io_context thread,
+// and it must outlive the io_context.
+_EXPORT class ConnectionPool {
+public:
+    explicit ConnectionPool(std::size_t reserved_bytes = 256 * 1024)
+        : reserved_ { std::make_unique<std::byte[]>(reserved_bytes) }
+        , upstream_ { reserved_.get(), reserved_bytes }
+    {
+    }
+    ConnectionPool(const ConnectionPool&) = delete;
+
+    auto resource() -> std::pmr::memory_resource* { return &pool_; }
+
+    // the object and its shared_ptr control block share one pooled block;
+    // the resource is passed on so the object can pool its own buffers
+    template <typename T, typename... Args>
+    auto make_shared(Args&&... args) -> std::shared_ptr<T>
+    {
+        return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T> { &pool_ }, std::forward<Args>(args)..., resource());
+    }
+
+private:
+    std::unique_ptr<std::byte[]> reserved_;
+    std::pmr::monotonic_buffer_resource upstream_;
+    std::pmr::unsynchronized_pool_resource pool_ { &upstream_ };
+};
@@ -0,0 +1,131 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "contest.hpp"
+#include "message.hpp"
+
+// Topic-based fan-out: room channels, the lobby, game spectators, user
+// inboxes. The subscribers of a topic are an immutable list replaced on every
+// change, so publishing takes the lock only to copy a pointer and then walks
+// its snapshot lock-free, even while subscribers come and go. A message is
+// serialized once per publish, whatever the audience, and handed to each
+// subscriber along with its text, so none of them parses it again.
+_EXPORT class TopicHub {
+public:
+    using Subscribers = std::vector<Participant_ptr>;
+
+    void subscribe(const std::string& topic, Participant_ptr participant)
+    {
+        std::lock_guard lock { mutex_ };
+        auto& subscribers { topics_[topic] };
+        if (subscribers && std::ranges::find(*subscribers, participant) != subscribers->end())
+            return;
+        auto next { subscribers ? std::make_shared<Subscribers>(*subscribers) : std::make_shared<Subscribers>() };
+        next->push_back(participant);
+        subscribers = std::move(next);
+        subscriptions_[participant].push_back(topic);
+    }
+
+    void unsubscribe(std::string_view topic, const Participant_ptr& participant)
+    {
+        std::lock_guard lock { mutex_ };
+        remove(topic, participant);
+        if (auto it = subscriptions_.find(participant); it != subscriptions_.end()) {
+            std::erase(it->second, topic);
+            if (it->second.empty())
+                subscriptions_.erase(it);
+        }
+    }
+
+    void unsubscribe_all(const Participant_ptr& participant)
+    {
+        std::lock_guard lock { mutex_ };
+        auto it { subscriptions_.find(participant) };
+        if (it == subscriptions_.end())
+            return;
+        for (auto& topic : it->second)
+            remove(topic, participant);
+        subscriptions_.erase(it);
+    }
+
+    auto subscribers(std::string_view topic) const -> std::shared_ptr<const Subscribers>
+    {
+        std::lock_guard lock { mutex_ };
+        auto it { topics_.find(topic) };
+        return it == topics_.end() ? nullptr : it->second;
+    }
+
+    // returns how many subscribers received the message
+    auto publish(std::string_view topic, Message msg, const Participant_ptr& except = nullptr) -> std::size_t
+    {
+        auto snapshot { subscribers(topic) };
+        if (!snapshot)
+            return 0;
+        return deliver(*snapshot, msg, msg.to_string(), except);
+    }
+
+    // `text` is `msg` serialized, e.g. kept for the chat history
+    auto publish_encoded(std::string_view topic, const Message& msg, std::string_view text, const Participant_ptr& except = nullptr) -> std::size_t
+    {
+        auto snapshot { subscribers(topic) };
+        if (!snapshot)
+            return 0;
+        return deliver(*snapshot, msg, text, except);
+    }
+
+    auto size() const
+    {
+        std::lock_guard lock { mutex_ };
+        return topics_.size();
+    }
+
+private:
+    struct Hash {
+        using is_transparent = void;
+        auto operator()(std::string_view s) const -> std::size_t { return std::hash<std::string_view> {}(s); }
+    };
+
+    static auto deliver(const Subscribers& subscribers, const Message& msg, std::string_view text, const Participant_ptr& except) -> std::size_t
+    {
+        std::size_t count {};
+        for (auto& subscriber : subscribers) {
+            if (subscriber == except)
+                continue;
+            subscriber->deliver_published(msg, text);
+            count++;
+        }
+        return count;
+    }
+
+    void remove(std::string_view topic, const Participant_ptr& participant)
+    {
+        auto it { topics_.find(topic) };
+        if (it == topics_.end() || std::ranges::find(*it->second, participant) == it->second->end())
+            return;
+        if (it->second->size() == 1) {
+            topics_.erase(it);
+            return;
+        }
+        auto next { std::make_shared<Subscribers>() };
+        next->reserve(it->second->size() - 1);
+        std::ranges::copy_if(*it->second, std::back_inserter(*next), [&](auto& p) { return p != participant; });
+        it->second = std::move(next);
+    }
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const Subscribers>, Hash, std::equal_to<>> topics_;
+    // the topics of each participant, so leaving doesn't search every topic
+    std::unordered_map<Participant_ptr, std::vector<std::string>> subscriptions_;
+};
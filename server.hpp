@@ -17,8 +17,11 @@
 #include <asio/co_spawn.hpp>
 #include <asio/detached.hpp>
 #include <asio/error_code.hpp>
+#include <asio/executor_work_guard.hpp>
 #include <asio/io_context.hpp>
 #include <asio/ip/tcp.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <asio/post.hpp>
 #include <asio/read_until.hpp>
 #include <asio/redirect_error.hpp>
 #include <asio/signal_set.hpp>
@@ -27,22 +30,47 @@
 #include <asio/write.hpp>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <filesystem>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
 #include <queue>
 #include <ranges>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
+#include "alloc.hpp"
+#include "archive.hpp"
+#include "chat.hpp"
+#include "botpool.hpp"
+#include "clock.hpp"
+#include "cluster.hpp"
 #include "contest.hpp"
+#include "http.hpp"
+#include "lobby.hpp"
 #include "log.hpp"
 #include "message.hpp"
+#include "metrics.hpp"
+#include "migration.hpp"
+#include "pubsub.hpp"
+#include "pool.hpp"
+#include "trace.hpp"
 #include "uimessage.hpp"
+#include "upgrade.hpp"
+#include "websocket.hpp"
 
 using asio::awaitable;
 using asio::co_spawn;
@@ -66,7 +94,9 @@ constexpr auto TIMEOUT { 30s };
 
 class Room;
 
-void start_session(asio::io_context&, Room&, asio::error_code&, std::string_view, std::string_view);
+Participant_ptr start_session(asio::io_context&, Room&, asio::error_code&, std::string_view, std::string_view);
+// connects without holding up the room, then calls `handler` on its thread
+void async_start_session(asio::io_context&, Room&, tcp::endpoint, std::function<void(const asio::error_code&, Participant_ptr)>);
 
 struct ContestRequest {
     Participant_ptr sender;
@@ -83,11 +113,21 @@ struct ContestRequest {
     }
 };
 
+// a queue of requests that can also be looked through
+struct RequestQueue : std::queue<ContestRequest, std::pmr::deque<ContestRequest>> {
+    using queue::queue;
+
+    auto requests() const -> const container_type& { return c; }
+};
+
 class Room {
+    // Room state is only touched from the io_context thread, so its queues
+    // allocate from an unsynchronized pool instead of the shared global heap
+    std::pmr::unsynchronized_pool_resource pool_;
     Contest contest;
     std::deque<std::string> chats;
     std::optional<ContestRequest> my_request;
-    std::queue<ContestRequest> received_requests;
+    RequestQueue received_requests { &pool_ };
 
     Participant_ptr find_local_participant()
     {
@@ -101,9 +141,168 @@ class Room {
         find_local_participant()->deliver(msg);
     }
 
+    auto presence_of(const Participant_ptr& participant) const
+    {
+        if (contest.status == Contest::Status::ON_GOING && contest.players.contains(Role::NONE, participant))
+            return PresenceStatus::IN_GAME;
+        if ((my_request && my_request->receiver == participant) || request_counts_.contains(participant))
+            return PresenceStatus::QUEUED;
+        return PresenceStatus::IDLE;
+    }
+
+    // the status of `participant` may have changed without it sending
+    // anything, update_related_presence republishes it
+    void presence_changed(const Participant_ptr& participant)
+    {
+        if (participant)
+            changed_presence_.insert(participant);
+    }
+
+    // received_requests and my_request change through these, which keep
+    // count of the requests per sender for presence_of
+    void push_request(ContestRequest request)
+    {
+        request_counts_[request.sender]++;
+        presence_changed(request.sender);
+        received_requests.push(std::move(request));
+    }
+    auto pop_request()
+    {
+        auto request { received_requests.front() };
+        received_requests.pop();
+        if (auto it = request_counts_.find(request.sender); it != request_counts_.end() && !--it->second)
+            request_counts_.erase(it);
+        presence_changed(request.sender);
+        return request;
+    }
+    void clear_requests()
+    {
+        for (auto& [sender, count] : request_counts_)
+            presence_changed(sender);
+        request_counts_.clear();
+        received_requests = decltype(received_requests) { &pool_ };
+    }
+    void set_my_request(std::optional<ContestRequest> request)
+    {
+        if (my_request)
+            presence_changed(my_request->receiver);
+        my_request = std::move(request);
+        if (my_request)
+            presence_changed(my_request->receiver);
+    }
+
+    // republish one participant under its current name and status, and keep
+    // its inbox topic following its name
+    void update_presence(const Participant_ptr& participant)
+    {
+        auto it { presence_ids_.find(participant) };
+        if (!participants_.contains(participant)) {
+            if (it != presence_ids_.end()) {
+                lobby_.erase(it->second);
+                presence_ids_.erase(it);
+            }
+            inboxes_.erase(participant);
+            return;
+        }
+        auto inbox { inbox_of(participant->get_name().empty() ? participant->endpoint().address().to_string() : participant->get_name()) };
+        if (auto& current = inboxes_[participant]; current != inbox) {
+            if (!current.empty())
+                topics_.unsubscribe(current, participant);
+            topics_.subscribe(inbox, participant);
+            current = std::move(inbox);
+        }
+
+        if (it == presence_ids_.end())
+            it = presence_ids_.emplace(participant, next_presence_id_++).first;
+        lobby_.set(it->second, participant->get_name().empty() ? participant->to_string() : participant->get_name(), presence_of(participant));
+    }
+
+    // the local player is reachable from the other nodes under its name
+    void update_cluster_name()
+    {
+        if (!cluster_)
+            return;
+        auto local { ranges::find_if(participants_, [](auto& p) { return p->is_local; }) };
+        std::string name { local == participants_.end() ? "" : std::string { (*local)->get_name() } };
+        if (name == cluster_name_)
+            return;
+        if (!cluster_name_.empty())
+            cluster_->unregister_user(cluster_name_);
+        if (!name.empty())
+            cluster_->register_user(name);
+        cluster_name_ = std::move(name);
+    }
+
+    // a message routed from a player on another node
+    void receive_from_cluster(const std::string& to, Participant_ptr from, Message msg)
+    {
+        if (to != cluster_name_) {
+            // chat for a remote player connected here, otherwise it moved on
+            if (msg.op == OpCode::CHAT_OP)
+                topics_.publish(inbox_of(to), msg);
+            else
+                logger->info("cluster: {} is not here, dropping {}", to, msg.to_string());
+            return;
+        }
+        auto op { msg.op };
+        auto joined { participants_.contains(from) };
+        if (op == OpCode::LEAVE_OP && !joined)
+            return;
+        // a request makes the sender a participant, like connecting would
+        if (op == OpCode::READY_OP && !joined)
+            join(from);
+        try {
+            process_data(std::move(msg), from);
+        } catch (std::exception& e) {
+            logger->error("cluster: {}", e.what());
+        }
+        // the peer protocol closes the connection after LEAVE_OP
+        if (op == OpCode::LEAVE_OP)
+            leave(from);
+    }
+
+    // Players in the game and those waiting on a request change status
+    // without sending anything themselves. The players, before and after,
+    // are two at most, and a request only concerns its sender, so this
+    // costs the number of changes and not the number of requests.
+    void update_related_presence()
+    {
+        std::array<Participant_ptr, 2> players;
+        if (contest.status == Contest::Status::ON_GOING)
+            for (auto role : { Role::BLACK, Role::WHITE })
+                if (auto player = contest.players.find(role))
+                    players[role == Role::BLACK ? 0 : 1] = player->participant;
+        for (auto& participant : std::exchange(players_, players))
+            presence_changed(participant);
+        for (auto& participant : players_)
+            presence_changed(participant);
+        for (auto& participant : changed_presence_)
+            update_presence(participant);
+        changed_presence_.clear();
+    }
+
+    // whenever the state shown by summary() may have changed
+    void changed()
+    {
+        version_++;
+        if (summary_)
+            summary_->publish(summary());
+    }
+
     void deliver_ui_state()
     {
-        deliver_to_local(UiMessage { contest });
+        TRACE_SCOPE("Room::deliver_ui_state");
+        update_related_presence();
+        changed();
+        if (archive_ && contest.status == Contest::Status::GAME_OVER && archived_start_time_ != contest.start_time) {
+            archived_start_time_ = contest.start_time;
+            // a local game is one person playing both sides, not a result
+            if (contest.players.at(Role::BLACK).participant != contest.players.at(Role::WHITE).participant)
+                archive_(GameArchive::make_record(contest));
+        }
+        UiMessage ui { contest };
+        deliver_to_local(ui);
+        topics_.publish(game_topic, ui);
     }
 
     auto receive_participant_name(Participant_ptr participant, std::string_view name)
@@ -132,7 +331,7 @@ class Room {
         if (received_requests.empty()) {
             deliver_to_local({ OpCode::RECEIVE_REQUEST_OP, request.sender->get_name(), request.role.map("b", "w", "") });
         }
-        received_requests.push(request);
+        push_request(request);
         deliver_ui_state();
     }
 
@@ -148,8 +347,7 @@ class Room {
     void reject_all_received_requests()
     {
         while (!received_requests.empty()) {
-            auto r = received_requests.front();
-            received_requests.pop();
+            auto r = pop_request();
             r.sender->deliver({ OpCode::REJECT_OP, r.receiver->get_name() });
         }
     }
@@ -174,17 +372,363 @@ class Room {
         }
     }
 
+    // the player to move loses on time after `remaining`
+    void start_clock(std::chrono::steady_clock::duration remaining)
+    {
+        auto opponent { contest.players.at(contest.current.role) };
+        auto local_game { contest.players.at(-contest.current.role).participant == opponent.participant };
+        timer_cancelled_ = false;
+        timer_->expires_after(remaining);
+        timer_->async_wait([this, opponent, local_game](const asio::error_code& ec) {
+            if (ec || timer_cancelled_)
+                return;
+            contest.timeout(opponent);
+            if (local_game)
+                opponent.participant->deliver({ OpCode::TIMEOUT_END_OP });
+            else
+                check_online_contest_result();
+            deliver_ui_state();
+        });
+    }
+
+    // removes a participant without telling anyone, as when it moved elsewhere
+    void drop(const Participant_ptr& participant)
+    {
+        participants_.erase(participant);
+        changed();
+        topics_.unsubscribe_all(participant);
+        update_presence(participant);
+    }
+
+    // `to` takes the place of `from` in the game and in the requests
+    void rebind(const Participant_ptr& from, const Participant_ptr& to)
+    {
+        contest.players.rebind(from, to);
+        auto replace = [&](ContestRequest& request) {
+            if (request.sender == from)
+                request.sender = to;
+            if (request.receiver == from)
+                request.receiver = to;
+        };
+        if (my_request)
+            replace(*my_request);
+        decltype(received_requests) requests { &pool_ };
+        requests.swap(received_requests);
+        for (; !requests.empty(); requests.pop()) {
+            received_requests.push(requests.front());
+            replace(received_requests.back());
+        }
+        if (auto count = request_counts_.extract(from))
+            request_counts_[to] += count.mapped();
+        presence_changed(to);
+        drop(from);
+    }
+
+    // The room as JSON, with each participant replaced by its slot in `slots`:
+    // a resume token, or the name of a player on another node.
+    auto save(std::map<Participant_ptr, std::string>& slots, std::optional<milliseconds> clock) -> json
+    {
+        json saved_slots = json::array();
+        auto slot_of = [&](const Participant_ptr& participant) {
+            auto [it, inserted] = slots.try_emplace(participant);
+            if (inserted) {
+                auto proxy { std::dynamic_pointer_cast<cluster::ClusterParticipant>(participant) };
+                it->second = proxy ? "cluster:" + proxy->user() : migration::make_token();
+                saved_slots.push_back({
+                    { "slot", it->second },
+                    { "kind", proxy ? "cluster" : participant->is_local ? "local" : "peer" },
+                    { "name", proxy ? proxy->user() : std::string { participant->get_name() } },
+                });
+            }
+            return it->second;
+        };
+        auto save_request = [&](const ContestRequest& request) -> json {
+            return { { "sender", slot_of(request.sender) }, { "receiver", slot_of(request.receiver) }, { "role", request.role.map("b", "w", "") } };
+        };
+        for (auto& participant : participants_)
+            slot_of(participant);
+        json saved {
+            { "contest", migration::save_contest(contest, slot_of) },
+            { "clock", clock ? json(clock->count()) : json(nullptr) },
+            { "my_request", my_request ? save_request(*my_request) : json(nullptr) },
+            { "received_requests", json::array() },
+            { "local_chat", local_chat_.entries() },
+            { "remote_chat", remote_chat_.entries() },
+        };
+        for (auto& request : received_requests.requests())
+            saved["received_requests"].push_back(save_request(request));
+        saved["slots"] = std::move(saved_slots);
+        return saved;
+    }
+
 public:
-    Room(asio::io_context& io_context)
-        : timer_ { io_context }
+    // takes over a room saved elsewhere, returns why not if it can't
+    auto restore(std::string_view migration, std::string_view snapshot) -> std::string
+    {
+        if (ranges::any_of(participants_, [](auto& p) { return p->is_local; }) || contest.status != Contest::Status::NOT_PREPARED
+            || my_request || !received_requests.empty() || !slots_.empty())
+            return "room is in use";
+        std::map<std::string, Participant_ptr> slots;
+        try {
+            auto saved = json::parse(snapshot);
+            for (auto& slot : saved["slots"]) {
+                auto id { slot["slot"].get<std::string>() }, kind { slot["kind"].get<std::string>() }, name { slot["name"].get<std::string>() };
+                if (kind == "cluster" && !cluster_)
+                    throw std::logic_error("room has players on other nodes, and this server is not in a cluster");
+                if (kind == "cluster")
+                    slots[id] = cluster_->proxy(name);
+                else
+                    slots[id] = std::make_shared<migration::ResumeParticipant>(id, name, kind == "local");
+            }
+            // before the chat is restored, or joining would replay it to them
+            for (auto& [id, participant] : slots)
+                join(participant);
+            auto participant_of = [&](const std::string& id) { return slots.at(id); };
+            migration::restore_contest(contest, saved["contest"], participant_of);
+            auto restore_request = [&](const json& request) {
+                return ContestRequest { participant_of(request["sender"]), participant_of(request["receiver"]), Role { request["role"].get<std::string>() } };
+            };
+            if (!saved["my_request"].is_null())
+                set_my_request(restore_request(saved["my_request"]));
+            for (auto& request : saved["received_requests"])
+                push_request(restore_request(request));
+            for (auto& text : saved["local_chat"])
+                local_chat_.append(Message { text.get<std::string>() });
+            for (auto& text : saved["remote_chat"])
+                remote_chat_.append(Message { text.get<std::string>() });
+            if (!saved["clock"].is_null())
+                start_clock(milliseconds { saved["clock"].get<long long>() });
+        } catch (std::exception& e) {
+            logger->error("restore: {}", e.what());
+            contest.clear();
+            set_my_request(std::nullopt);
+            clear_requests();
+            for (auto& [id, participant] : slots)
+                drop(participant);
+            return e.what();
+        }
+        migration_ = migration;
+        slots_ = std::move(slots);
+        // whoever has not come back by then is gone
+        resume_timer_->expires_after(resume_timeout);
+        resume_timer_->async_wait([this](const asio::error_code& ec) {
+            if (ec)
+                return;
+            for (auto& [id, participant] : std::exchange(slots_, {})) {
+                if (!std::dynamic_pointer_cast<migration::ResumeParticipant>(participant))
+                    continue;
+                logger->info("restore: slot {} was not resumed", id);
+                try {
+                    leave(participant);
+                } catch (std::exception& e) {
+                    logger->error("restore: {}", e.what());
+                }
+            }
+            migration_.clear();
+        });
+        if (ranges::any_of(participants_, [](auto& p) { return p->is_local; }))
+            deliver_ui_state();
+        update_cluster_name();
+        logger->info("restore: took over room {} with {} participants", migration, participants_.size());
+        return "";
+    }
+
+    // input for a slot of the room taken over, that reached it while frozen
+    void receive_migrated_input(std::string_view migration, std::string_view slot, Message msg)
+    {
+        auto it { slots_.find(std::string { slot }) };
+        if (migration != migration_ || it == slots_.end())
+            return;
+        try {
+            process_data(std::move(msg), it->second);
+        } catch (std::exception& e) {
+            logger->error("migrated input: {}", e.what());
+        }
+    }
+
+    // `clock` is the steady one unless given, and must outlive the room
+    Room(asio::io_context& io_context, timing::Clock* clock = nullptr)
+        : steady_clock_ { clock ? nullptr : std::make_unique<timing::SteadyClock>(io_context) }
+        , clock_ { clock ? *clock : *steady_clock_ }
+        , timer_ { clock_.timer() }
+        , resume_timer_ { clock_.timer() }
         , io_context_ { io_context }
         , my_request { std::nullopt }
+        , lobby_ { io_context.get_executor(), topics_ }
+    {
+    }
+#ifdef NOGO_HAS_BOT_WORKERS
+    void set_bot_pool(BotPool* bot_pool)
+    {
+        bot_pool_ = bot_pool;
+    }
+#endif
+    void set_chat_log(ChatLog* chat_log)
     {
+        chat_log_ = chat_log;
+    }
+    // receives the record of every online game that ends
+    void set_archive(std::function<void(GameRecord)> archive)
+    {
+        archive_ = std::move(archive);
+    }
+    // kept up to date with summary()
+    void set_summary(Snapshot<json>* summary)
+    {
+        summary_ = summary;
+        changed();
+    }
+    void set_cluster(cluster::Cluster* cluster)
+    {
+        cluster_ = cluster;
+        cluster_->set_local_name([this] { return cluster_name_; });
+        cluster_->set_handler([this](auto& to, auto from, auto msg) { receive_from_cluster(to, std::move(from), std::move(msg)); });
+        cluster_->set_migration_handler(
+            [this](auto migration, auto snapshot) { return restore(migration, snapshot); },
+            [this](auto migration, auto slot, auto msg) { receive_migrated_input(migration, slot, std::move(msg)); });
+    }
+    // A room on its way elsewhere: saved, with the slot of every participant,
+    // and not handling anything until it is thawed or released.
+    struct Frozen {
+        std::string snapshot;
+        std::map<Participant_ptr, std::string> slots;
+        std::optional<milliseconds> clock;
+    };
+    auto freeze() -> Frozen
+    {
+        if (frozen_) {
+            throw std::logic_error("room is already frozen");
+        }
+        frozen_ = true;
+        Frozen frozen;
+        if (auto now = clock_.now(); contest.status == Contest::Status::ON_GOING && !timer_cancelled_ && timer_->expiry() > now)
+            frozen.clock = std::chrono::duration_cast<milliseconds>(timer_->expiry() - now);
+        timer_cancelled_ = true;
+        timer_->cancel();
+        frozen.snapshot = save(frozen.slots, frozen.clock).dump();
+        return frozen;
+    }
+    // the room stays here after all: catch up on what arrived meanwhile
+    void thaw(const Frozen& frozen)
+    {
+        frozen_ = false;
+        if (frozen.clock)
+            start_clock(*frozen.clock);
+        for (auto& [msg, participant] : std::exchange(frozen_inputs_, {})) {
+            try {
+                process_data(std::move(msg), participant);
+            } catch (std::exception& e) {
+                logger->error("thaw: {}", e.what());
+            }
+        }
+    }
+    // what arrived while frozen, by slot
+    auto frozen_inputs(const Frozen& frozen) const
+    {
+        std::vector<std::pair<std::string, Message>> inputs;
+        for (auto& [msg, participant] : frozen_inputs_)
+            if (auto it = frozen.slots.find(participant); it != frozen.slots.end())
+                inputs.emplace_back(it->second, msg);
+        return inputs;
+    }
+    auto joined(const Participant_ptr& participant) const { return participants_.contains(participant); }
+    // The room was taken over elsewhere: `hand_off` is called for every
+    // participant still here, which is then dropped, and the room is left
+    // empty. Returns what arrived while frozen, by slot.
+    auto release(const Frozen& frozen, const std::function<void(const Participant_ptr&, const std::string& slot)>& hand_off)
+    {
+        frozen_ = false;
+        for (auto& [participant, slot] : frozen.slots) {
+            if (!participants_.contains(participant))
+                continue;
+            hand_off(participant, slot);
+            drop(participant);
+        }
+        auto inputs { frozen_inputs(frozen) };
+        frozen_inputs_.clear();
+        contest.clear();
+        set_my_request(std::nullopt);
+        clear_requests();
+        update_cluster_name();
+        return inputs;
+    }
+
+    // Moves the room to another node of the cluster: once it is taken over
+    // there, everyone connected directly is redirected with a token to
+    // resume their seat. `done` gets an empty string once the room is gone
+    // from here.
+    void migrate(std::function<void(std::string_view error)> done)
+    {
+        if (!cluster_) {
+            throw std::logic_error("migration needs cluster mode");
+        }
+        auto frozen { std::make_shared<Frozen>(freeze()) };
+        auto id { migration::make_token() };
+        cluster_->migrate(id, frozen->snapshot, [this, id, frozen, done](const cluster::Node* node, std::string_view error) {
+            if (!node) {
+                logger->error("migrate: {}", error);
+                thaw(*frozen);
+                done(error);
+                return;
+            }
+            logger->info("migrate: room {} taken over by {}", id, node->id);
+            auto name { cluster_name_ };
+            auto inputs { release(*frozen, [&](auto& participant, auto& slot) {
+                if (!std::dynamic_pointer_cast<cluster::ClusterParticipant>(participant)) {
+                    auto port { participant->is_local ? node->port : node->peer_port };
+                    participant->deliver({ OpCode::REDIRECT_OP, node->host + ":" + std::to_string(port), slot });
+                }
+            }) };
+            if (!name.empty())
+                cluster_->moved(name, node->id);
+            for (auto& [slot, msg] : inputs)
+                cluster_->send_input(node->id, id, slot, std::move(msg));
+            done("");
+        });
+    }
+    // changes whenever the state shown by summary() may have changed
+    auto version() const { return version_; }
+    auto summary() const -> json
+    {
+        json players = json::array();
+        for (auto role : { Role::BLACK, Role::WHITE })
+            if (auto player = contest.players.find(role))
+                players.push_back({ { "name", player->name }, { "role", role.id } });
+        return {
+            { "status", contest.status },
+            { "move_count", contest.round() },
+            { "participants", participants_.size() },
+            { "players", players },
+        };
     }
     void process_data(Message msg, Participant_ptr participant)
     {
+        TRACE_SCOPE("Room::process_data", std::to_underlying(msg.op));
+        ALLOC_SCOPE("Room::process_data", std::to_underlying(msg.op));
         logger->info("process_data: {} from {}:{}", msg.to_string(), participant->endpoint().address().to_string(), participant->endpoint().port());
         const string_view data1 { msg.data1 }, data2 { msg.data2 };
+        // held back until it is known which node the room ends up on
+        if (frozen_) {
+            frozen_inputs_.emplace_back(std::move(msg), participant);
+            return;
+        }
+        // whatever the message changed, the lobby catches up when it is
+        // handled; a failure to do so is logged, not thrown over the error
+        // the message may be unwinding with
+        struct PresenceUpdate {
+            Room& room;
+            const Participant_ptr& participant;
+            ~PresenceUpdate()
+            {
+                try {
+                    room.update_presence(participant);
+                    room.update_related_presence();
+                    room.update_cluster_name();
+                } catch (std::exception& e) {
+                    logger->error("update_presence: {}", e.what());
+                }
+            }
+        } presence_update { *this, participant };
 
         switch (msg.op) {
         case OpCode::WIN_PENDING_OP: {
@@ -233,9 +777,9 @@ public:
             break;
         }
         case OpCode::LOCAL_GAME_MOVE_OP: {
-            timer_.cancel();
+            timer_->cancel();
 
-            Position pos { data1 };
+            Point pos { data1 };
             Role role { data2 };
 
             auto player { contest.players.at(role, participant) };
@@ -244,19 +788,60 @@ public:
             contest.play(player, pos);
 
             if (contest.status == Contest::Status::ON_GOING) {
-                timer_.expires_after(contest.duration);
-                timer_.async_wait([this, opponent](const asio::error_code& ec) {
-                    if (!ec) {
-                        contest.timeout(opponent);
-                        opponent.participant->deliver({ OpCode::TIMEOUT_END_OP });
-                        deliver_ui_state();
-                    }
-                });
+                start_clock(contest.duration);
             }
 
             deliver_ui_state();
             break;
         }
+        case OpCode::BOT_MOVE_OP: {
+            // let a bot worker play for the local player: both sides of a local
+            // game, or its own side of an online one, where the move reaches
+            // the peer as any other MOVE_OP
+#ifdef NOGO_HAS_BOT_WORKERS
+            if (!participant->is_local) {
+                throw std::logic_error("BOT_MOVE_OP should not be sent by remote");
+            }
+            if (!bot_pool_) {
+                throw std::logic_error("bot workers are not enabled");
+            }
+            if (contest.status != Contest::Status::ON_GOING) {
+                throw std::logic_error("Contest not started");
+            }
+            auto round { contest.round() };
+            auto role { contest.current.role };
+            if (contest.players.at(role).participant != participant) {
+                throw std::logic_error("BOT_MOVE_OP out of turn");
+            }
+            auto local_game { contest.players.at(Role::BLACK).participant == contest.players.at(Role::WHITE).participant };
+            bot_pool_->query(contest.current, [this, participant, round, role, local_game](auto response) {
+                if (!response || contest.status != Contest::Status::ON_GOING || contest.round() != round)
+                    return;
+                try {
+                    auto side { role.map("b", "w", "") };
+                    // no legal move is left for the bot, which loses
+                    if (!response->move && !local_game) {
+                        process_data({ OpCode::GIVEUP_OP, side }, participant);
+                    } else if (!response->move) {
+                        contest.concede(contest.players.at(role, participant));
+                        timer_cancelled_ = true;
+                        timer_->cancel();
+                        deliver_ui_state();
+                    } else if (local_game) {
+                        process_data({ OpCode::LOCAL_GAME_MOVE_OP, response->move.to_string(), side }, participant);
+                    } else {
+                        auto now { std::chrono::duration_cast<milliseconds>(system_clock::now().time_since_epoch()) };
+                        process_data({ OpCode::MOVE_OP, response->move.to_string(), std::to_string(now.count()) }, participant);
+                    }
+                } catch (std::exception& e) {
+                    logger->error("BOT_MOVE_OP: {}", e.what());
+                }
+            });
+#else
+            throw std::logic_error("bot workers are not supported on this platform");
+#endif
+            break;
+        }
 
         case OpCode::UPDATE_USERNAME_OP: {
             if (!participant->is_local) {
@@ -282,7 +867,7 @@ public:
 
             auto receiver { participants[0] };
             ContestRequest request { participant, receiver, role };
-            my_request = request;
+            set_my_request(request);
             receiver->deliver({ OpCode::READY_OP, participant->get_name(), data2 });
             break;
         }
@@ -291,13 +876,23 @@ public:
             auto participants = participants_ | std::views::filter([data1](auto p) { return p->get_name() == data1; })
                 | ranges::to<std::vector>();
 
+            // not connected here, the player may be on another node
+            if (participants.empty() && cluster_) {
+                if (cluster_name_.empty()) {
+                    throw std::logic_error { "set a username before sending requests across the cluster" };
+                }
+                auto proxy { cluster_->proxy(std::string { data1 }) };
+                join(proxy);
+                participants.push_back(proxy);
+            }
+
             if (participants.size() != 1) {
                 throw std::logic_error { "participants.size() != 1" };
             }
 
             auto receiver { participants[0] };
             ContestRequest request { participant, receiver, Role { data2 } };
-            my_request = request;
+            set_my_request(request);
             receiver->deliver({ OpCode::READY_OP, participant->get_name(), data2 });
             break;
         }
@@ -309,8 +904,7 @@ public:
             if (received_requests.empty()) {
                 throw std::logic_error { "received_requests.empty()" };
             }
-            auto request = received_requests.front();
-            received_requests.pop();
+            auto request = pop_request();
             reject_all_received_requests();
             request.sender->deliver({ OpCode::READY_OP, request.receiver->get_name(), (-request.role).map("b", "w", "") });
             enroll_players(request);
@@ -321,8 +915,7 @@ public:
             if (received_requests.empty()) {
                 throw std::logic_error { "received_requests.empty()" };
             }
-            auto request = received_requests.front();
-            received_requests.pop();
+            auto request = pop_request();
             request.sender->deliver({ OpCode::REJECT_OP, request.receiver->get_name() });
             if (!received_requests.empty()) {
                 auto next_request = received_requests.front();
@@ -349,7 +942,7 @@ public:
                     deliver_to_local({ OpCode::RECEIVE_REQUEST_RESULT_OP, "accepted", name });
                     // contest accepted, enroll players
                     enroll_players(my_request.value());
-                    my_request = std::nullopt;
+                    set_my_request(std::nullopt);
                     reject_all_received_requests();
                 } else {
                     // receive request
@@ -371,17 +964,17 @@ public:
             } else {
                 if (my_request.has_value() && participant == my_request->receiver) {
                     deliver_to_local({ OpCode::RECEIVE_REQUEST_RESULT_OP, "rejected", name });
-                    my_request = std::nullopt;
+                    set_my_request(std::nullopt);
                 }
             }
             break;
         }
         case OpCode::MOVE_OP: {
             timer_cancelled_ = true;
-            timer_.cancel();
+            timer_->cancel();
             std::cout << "timer canceled" << std::endl;
 
-            Position pos { data1 };
+            Point pos { data1 };
             milliseconds ms { stoull(data2) };
 
             // TODO: adjust time
@@ -396,15 +989,7 @@ public:
 
             if (contest.status == Contest::Status::ON_GOING) {
                 contest.duration = TIMEOUT;
-                timer_cancelled_ = false;
-                timer_.expires_after(contest.duration);
-                timer_.async_wait([this, opponent, participant](const asio::error_code& ec) {
-                    if (!ec && !timer_cancelled_) {
-                        contest.timeout(opponent);
-                        check_online_contest_result();
-                        deliver_ui_state();
-                    }
-                });
+                start_clock(contest.duration);
             }
 
             deliver_ui_state();
@@ -421,7 +1006,7 @@ public:
 
             contest.concede(player);
             timer_cancelled_ = true;
-            timer_.cancel();
+            timer_->cancel();
 
             check_online_contest_result();
             deliver_ui_state();
@@ -446,7 +1031,7 @@ public:
                     auto result_valid { claimed_win_type == contest.result.win_type };
                     // Use lenient validation for timeout
                     if (claimed_win_type == Contest::WinType::TIMEOUT && !result_valid) {
-                        auto remain_time { std::chrono::duration_cast<milliseconds>(timer_.expiry() - std::chrono::steady_clock::now()) };
+                        auto remain_time { std::chrono::duration_cast<milliseconds>(timer_->expiry() - clock_.now()) };
                         // 270ms is the median human reaction time (reference: https://humanbenchmark.com/tests/reactiontime/statistics)
                         if (remain_time < 270ms) {
                             result_valid = true;
@@ -483,33 +1068,25 @@ public:
             break;
         }
         case OpCode::CHAT_OP: {
-            recent_msgs_.push_back(msg);
-            while (recent_msgs_.size() > max_recent_msgs)
-                recent_msgs_.pop_front();
-
             if (participant->is_local) {
                 throw std::logic_error("CHAT_OP should not be sent by local");
             } else {
-                auto name = participant->get_name();
+                std::string name { participant->get_name() };
                 if (name.empty()) {
                     name = participant->endpoint().address().to_string();
                 }
-                deliver_to_local({ OpCode::CHAT_RECEIVE_MESSAGE_OP, data1, name });
+                Message chat { OpCode::CHAT_RECEIVE_MESSAGE_OP, data1, name };
+                record_chat(local_chat_, chat, name);
+                deliver_to_local(chat);
             }
             break;
         }
         case OpCode::CHAT_SEND_MESSAGE_OP: {
             if (participant->is_local) {
-                auto success = false;
-                for (auto participant : participants_) {
-                    if (!participant->get_name().empty() && participant->get_name() == data2) {
-                        participant->deliver({ OpCode::CHAT_OP, data1 });
-                        success = true;
-                    } else if (participant->get_name().empty() && participant->endpoint().address().to_string() == data2) {
-                        participant->deliver({ OpCode::CHAT_OP, data1 });
-                        success = true;
-                    }
-                }
+                // by name, or by address for a participant without one
+                auto success = topics_.publish(inbox_of(data2), { OpCode::CHAT_OP, data1 }) > 0;
+                if (!success && cluster_ && !cluster_name_.empty())
+                    cluster_->proxy(std::string { data2 })->deliver({ OpCode::CHAT_OP, data1 });
             } else {
                 throw std::logic_error("CHAT_SEND_MESSAGE_OP should not be sent by remote");
             }
@@ -517,7 +1094,9 @@ public:
         }
         case OpCode::CHAT_SEND_BROADCAST_MESSAGE_OP: {
             if (participant->is_local) {
-                deliver_to_others({ OpCode::CHAT_OP, data1 }, participant);
+                Message chat { OpCode::CHAT_OP, data1 };
+                auto text { record_chat(remote_chat_, chat, participant->get_name()) };
+                topics_.publish_encoded(room_topic, chat, text, participant);
             } else {
                 throw std::logic_error("CHAT_SEND_BROADCAST_MESSAGE_OP should not be sent by remote");
             }
@@ -527,15 +1106,125 @@ public:
             // should not be sent by client
             break;
         }
+        case OpCode::LOBBY_SUBSCRIBE_OP: {
+            lobby_.subscribe(participant);
+            break;
+        }
+        case OpCode::LOBBY_UNSUBSCRIBE_OP: {
+            lobby_.unsubscribe(participant);
+            break;
+        }
+        case OpCode::LOBBY_SNAPSHOT_OP:
+        case OpCode::LOBBY_UPDATE_OP: {
+            // should not be sent by client
+            break;
+        }
+        case OpCode::TOPIC_SUBSCRIBE_OP: {
+            if (data1 == Lobby::topic) {
+                lobby_.subscribe(participant);
+            } else if (data1.starts_with("user/") || data1 == room_topic) {
+                throw std::logic_error("topic cannot be subscribed");
+            } else {
+                if (!participant->is_local && !topics_.subscribers(data1) && topics_.size() >= max_topics)
+                    throw std::logic_error("too many topics");
+                topics_.subscribe(msg.data1, participant);
+            }
+            break;
+        }
+        case OpCode::TOPIC_UNSUBSCRIBE_OP: {
+            // the room and the inboxes follow the participant, the game and
+            // the lobby are left as any other topic
+            if (data1 == Lobby::topic) {
+                lobby_.unsubscribe(participant);
+            } else if (data1.starts_with("user/") || data1 == room_topic) {
+                throw std::logic_error("topic cannot be unsubscribed");
+            } else {
+                topics_.unsubscribe(data1, participant);
+            }
+            break;
+        }
+        case OpCode::TOPIC_PUBLISH_OP: {
+            if (is_server_topic(data1)) {
+                throw std::logic_error("topic is read only");
+            }
+            json payload { { "from", participant->get_name() }, { "text", msg.data2 } };
+            topics_.publish(data1, { OpCode::TOPIC_MESSAGE_OP, data1, payload.dump() });
+            break;
+        }
+        case OpCode::TOPIC_MESSAGE_OP: {
+            // should not be sent by client
+            break;
+        }
+        case OpCode::REDIRECT_OP: {
+            // data1 is host:port of the node the room moved to, data2 is the token
+            if (participant->is_local) {
+                throw std::logic_error("REDIRECT_OP should not be sent by local");
+            }
+            // only the peer of the game follows the room, and only to a node
+            // of the cluster
+            if (!contest.players.contains(Role::NONE, participant)) {
+                throw std::logic_error("REDIRECT_OP from a peer that is not playing here");
+            }
+            auto host { std::string { data1.substr(0, data1.rfind(':')) } };
+            auto port { std::string { data1.substr(data1.rfind(':') + 1) } };
+            auto is_target = [&](const cluster::Node& node) {
+                return node.host == host && (std::to_string(node.port) == port || std::to_string(node.peer_port) == port);
+            };
+            if (!cluster_ || std::ranges::none_of(cluster_->config().nodes, is_target)) {
+                throw std::logic_error("REDIRECT_OP to " + msg.data1 + ", which is not a node of the cluster");
+            }
+            tcp::endpoint endpoint { asio::ip::make_address(host), static_cast<asio::ip::port_type>(std::stoi(port)) };
+            // a placeholder keeps the seat, and what the room sends, while
+            // connecting
+            auto placeholder { std::make_shared<migration::ResumeParticipant>(msg.data2, std::string { participant->get_name() }, false) };
+            join(placeholder, false);
+            rebind(participant, placeholder);
+            async_start_session(io_context_, *this, endpoint, [this, placeholder, target = msg.data1](const asio::error_code& ec, Participant_ptr session) {
+                if (!session) {
+                    logger->error("redirect to {} failed: {}", target, ec.message());
+                    leave(placeholder);
+                    return;
+                }
+                session->set_name(placeholder->get_name());
+                session->deliver({ OpCode::RESUME_OP, placeholder->token });
+                rebind(placeholder, session);
+                for (auto& pending : placeholder->pending)
+                    session->deliver(std::move(pending));
+                update_related_presence();
+            });
+            break;
+        }
+        case OpCode::RESUME_OP: {
+            auto it { slots_.find(msg.data1) };
+            auto placeholder { it == slots_.end() ? nullptr : std::dynamic_pointer_cast<migration::ResumeParticipant>(it->second) };
+            if (!placeholder || placeholder->is_local != participant->is_local) {
+                throw std::logic_error("unknown resume token");
+            }
+            participant->set_name(placeholder->get_name());
+            rebind(placeholder, participant);
+            it->second = participant;
+            for (auto& pending : placeholder->pending)
+                participant->deliver(std::move(pending));
+            if (std::ranges::none_of(slots_, [](auto& slot) { return std::dynamic_pointer_cast<migration::ResumeParticipant>(slot.second) != nullptr; }))
+                resume_timer_->cancel();
+            break;
+        }
         }
     }
-    void join(Participant_ptr participant)
+    // `catch_up` replays the recent chat, for those who haven't seen it
+    void join(Participant_ptr participant, bool catch_up = true)
     {
         logger->info("{}:{} join", participant->endpoint().address().to_string(), participant->endpoint().port());
         participants_.insert(participant);
-        // for (auto msg : recent_msgs_) {
-        //     participant->deliver(msg);
-        // }
+        changed();
+        topics_.subscribe(std::string { room_topic }, participant);
+        update_presence(participant);
+        if (participant->lobby_on_join())
+            lobby_.subscribe(participant);
+        // catch up on the chat this kind of participant would have received
+        auto& history { participant->is_local ? local_chat_ : remote_chat_ };
+        if (catch_up && history.size())
+            participant->deliver_encoded(history.entries());
     }
 
     void leave(Participant_ptr participant)
@@ -547,9 +1236,13 @@ public:
         }
         logger->debug("leave: erase participant, participants_.size() = {}", participants_.size());
         participants_.erase(participant);
+        changed();
+        topics_.unsubscribe_all(participant);
+        update_presence(participant);
+        update_cluster_name();
         logger->debug("leave: erase end, participants_.size() = {}", participants_.size());
         logger->debug("leave: remove all requests from {}:{} in received_requests", participant->endpoint().address().to_string(), participant->endpoint().port());
-        std::queue<ContestRequest> requests {};
+        decltype(received_requests) requests { &pool_ };
         requests.swap(received_requests);
         auto is_first { !requests.empty() && requests.front().sender == participant };
         while (!requests.empty()) {
@@ -559,18 +1252,20 @@ public:
                 received_requests.push(request);
             }
         }
+        request_counts_.erase(participant);
         if (is_first && !received_requests.empty()) {
             logger->debug("leave: is_first && !received_requests.empty(), send received_requests.front() to local");
             deliver_to_local({ OpCode::RECEIVE_REQUEST_OP, received_requests.front().sender->get_name(), received_requests.front().role.map("b", "w", "") });
         }
-        if (participant == my_request->receiver) {
+        if (my_request && participant == my_request->receiver) {
             logger->debug("leave: my_request->receiver == participant, clear my_request");
-            my_request = std::nullopt;
+            set_my_request(std::nullopt);
         }
         if (!participant->get_name().empty()) {
             logger->debug("leave: participant->get_name() is not empty, send LEAVE_OP to local");
             deliver_to_local({ OpCode::LEAVE_OP, participant->get_name() });
         }
+        update_related_presence();
     }
 
     void close_except(Participant_ptr participant)
@@ -585,6 +1280,8 @@ public:
                 p->deliver({ OpCode::LEAVE_OP });
                 logger->debug("close_except: erase it");
                 it = participants_.erase(it);
+                topics_.unsubscribe_all(p);
+                update_presence(p);
                 logger->debug("close_except: end");
             } else {
                 logger->debug("close_except: skip self");
@@ -597,29 +1294,135 @@ public:
     void deliver_to_others(Message msg, Participant_ptr participant)
     {
         std::cout << "deliver to others: self = " << participant->endpoint() << std::endl;
-        recent_msgs_.push_back(msg);
-        while (recent_msgs_.size() > max_recent_msgs)
-            recent_msgs_.pop_front();
-
-        for (auto p : participants_) {
-            if (p != participant) {
-                logger->info("broadcast {} from {}:{}", msg.to_string(), participant->endpoint().address().to_string(), participant->endpoint().port());
-                p->deliver(msg);
-            }
-        }
+        logger->info("broadcast {} from {}:{}", msg.to_string(), participant->endpoint().address().to_string(), participant->endpoint().port());
+        topics_.publish(room_topic, msg, participant);
     }
 
 private:
+    // every participant of the room, the spectators of its game, and one
+    // inbox per user for private chat
+    static constexpr std::string_view room_topic { "room" }, game_topic { "game" };
+
+    static auto inbox_of(std::string_view name) -> std::string
+    {
+        return "user/" + std::string { name };
+    }
+    // remote peers open no more topics than this, the hub would grow with
+    // every name they make up
+    static constexpr std::size_t max_topics { 1024 };
+    // topics only the server publishes to
+    static auto is_server_topic(std::string_view topic) -> bool
+    {
+        return topic == room_topic || topic == game_topic || topic == Lobby::topic || topic.starts_with("user/");
+    }
+
+    auto record_chat(ChatHistory& history, Message msg, std::string_view from) -> std::string_view
+    {
+        auto text { history.append(std::move(msg)) };
+        if (chat_log_)
+            chat_log_->append(from, text);
+        return text;
+    }
+
+    static constexpr auto resume_timeout { 10s };
+
     bool timer_cancelled_ {};
-    asio::steady_timer timer_;
+    std::unique_ptr<timing::Clock> steady_clock_;
+    timing::Clock& clock_;
+    std::unique_ptr<timing::Clock::Timer> timer_;
+    std::unique_ptr<timing::Clock::Timer> resume_timer_;
     asio::io_context& io_context_;
 
     std::set<Participant_ptr> participants_;
-    enum { max_recent_msgs = 100 };
-    std::deque<Message> recent_msgs_;
+#ifdef NOGO_HAS_BOT_WORKERS
+    BotPool* bot_pool_ {};
+#endif
+    std::function<void(GameRecord)> archive_;
+    Snapshot<json>* summary_ {};
+    std::optional<system_clock::time_point> archived_start_time_;
+    std::uint64_t version_ {};
+    ChatLog* chat_log_ {};
+    cluster::Cluster* cluster_ {};
+    // the name the local player is registered under in the cluster
+    std::string cluster_name_;
+    // migrating away: what arrives meanwhile is held back
+    bool frozen_ {};
+    std::vector<std::pair<Message, Participant_ptr>> frozen_inputs_;
+    // taken over from another node: the slots of the room, until resumed
+    std::string migration_;
+    std::map<std::string, Participant_ptr> slots_;
+    TopicHub topics_;
+    Lobby lobby_;
+    // the id each participant is listed under in the lobby
+    std::map<Participant_ptr, Lobby::Id> presence_ids_;
+    Lobby::Id next_presence_id_ { 1 };
+    std::map<Participant_ptr, std::string> inboxes_;
+    // received requests by sender, the players of the game as last seen, and
+    // who may have changed status since, see update_related_presence
+    std::pmr::map<Participant_ptr, std::size_t> request_counts_ { &pool_ };
+    std::array<Participant_ptr, 2> players_;
+    std::pmr::set<Participant_ptr> changed_presence_ { &pool_ };
+    // chat as delivered to the local frontend, and as broadcast to remote players
+    ChatHistory local_chat_, remote_chat_;
 };
 
-class Session : public Participant, public std::enable_shared_from_this<Session> {
+// Framing policy of BasicSession: newline-delimited JSON messages
+_EXPORT class LineFraming {
+public:
+    explicit LineFraming(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : buffer_ { resource }
+    {
+    }
+
+    template <typename Socket>
+    awaitable<void> accept(Socket&)
+    {
+        co_return;
+    }
+
+    // Reads a chunk at a time rather than through a dynamic buffer, which
+    // grows the line with room for a pending read: the buffer only ever holds
+    // bytes that were received, so it can be handed over mid-read.
+    template <typename Socket>
+    awaitable<std::string> read(Socket& socket, auto&&)
+    {
+        for (;;) {
+            if (auto end = buffer_.find('\n'); end != buffer_.npos) {
+                std::string line { buffer_.data(), end + 1 };
+                buffer_.erase(0, end + 1);
+                co_return line;
+            }
+            if (buffer_.size() >= max_line)
+                throw std::length_error("line too long");
+            auto n { co_await socket.async_read_some(asio::buffer(chunk_), use_awaitable) };
+            buffer_.append(chunk_.data(), n);
+        }
+    }
+
+    // the local frontend keeps its seat when its connection drops
+    static constexpr bool local_leaves_on_close { false };
+    // peers and the frontend of the line protocol ask for the lobby
+    static constexpr bool lobby_on_join { false };
+
+    auto encode(std::string_view text) -> std::string
+    {
+        return std::string { text } + "\n";
+    }
+
+    // bytes received but not handled yet, for a session changing process
+    auto read_ahead() const -> std::string_view { return buffer_; }
+    void restore(std::string_view read_ahead) { buffer_ = read_ahead; }
+
+private:
+    static constexpr std::size_t max_line { 1024 };
+    std::pmr::string buffer_;
+    std::array<char, max_line> chunk_;
+};
+
+template <typename Protocol, typename Framing = LineFraming>
+class BasicSession : public Participant, public upgrade::Transferable, public std::enable_shared_from_this<BasicSession<Protocol, Framing>> {
+    using socket_type = typename Protocol::socket;
+
 public:
     std::string_view get_name() const override
     {
@@ -631,8 +1434,9 @@ public:
     }
     tcp::endpoint endpoint() const override
     {
-        return is_local ? socket_.local_endpoint() : socket_.remote_endpoint();
+        return endpoint_;
     }
+    bool lobby_on_join() const override { return Framing::lobby_on_join; }
     bool operator==(const Participant& participant) const override
     {
         // TODO: Use a better comparsion
@@ -640,39 +1444,120 @@ public:
             return get_name() == participant.get_name();
         return endpoint() == participant.endpoint();
     }
-    Session(tcp::socket socket, Room& room, bool is_local = false)
+    BasicSession(socket_type socket, Room& room, bool is_local = false, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
         : Participant { is_local }
         , name_("")
         , socket_(std::move(socket))
         , timer_(socket_.get_executor())
+        , endpoint_ { query_endpoint(socket_, is_local) }
         , room_(room)
+        , framing_ { make_framing(resource) }
+        , write_msgs_ { resource }
     {
         timer_.expires_at(std::chrono::steady_clock::time_point::max());
     }
 
     void start()
     {
-        room_.join(shared_from_this());
-
         co_spawn(
-            socket_.get_executor(), [self = shared_from_this()] { return self->reader(); }, detached);
+            socket_.get_executor(), [self = this->shared_from_this()] { return self->run(); }, detached);
+    }
 
-        co_spawn(
-            socket_.get_executor(), [self = shared_from_this()] { return self->writer(); }, detached);
+    // a connection handed over by the process this one upgraded: claim the
+    // seat of `token` and carry on reading where the old process stopped
+    void resume(std::string token, std::string_view read_ahead)
+    {
+        resume_token_ = std::move(token);
+        if constexpr (requires { framing_.restore(read_ahead); })
+            framing_.restore(read_ahead);
+    }
+
+    bool idle() const override
+    {
+        return write_msgs_.empty() && !writing_;
+    }
+
+    bool pause() override
+    {
+        if constexpr (requires { framing_.read_ahead(); }) {
+            // a read that already completed still gets handled, as input of
+            // the frozen room
+            paused_ = true;
+            // cancelling would abort a write under way as well
+            if (writing_)
+                return false;
+            asio::error_code ec;
+            socket_.cancel(ec);
+            return !reading_;
+        }
+        return true;
+    }
+
+    void unpause() override
+    {
+        if (!paused_)
+            return;
+        paused_ = false;
+        if (!reading_ && socket_.is_open())
+            co_spawn(
+                socket_.get_executor(), [self = this->shared_from_this()] { return self->reader(); }, detached);
+    }
+
+    auto handoff() -> std::optional<Handoff> override
+    {
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+        if constexpr (requires { framing_.read_ahead(); }) {
+            Handoff handoff { ::dup(socket_.native_handle()), "unix", std::string { framing_.read_ahead() } };
+            if (handoff.fd < 0)
+                return std::nullopt;
+            if constexpr (std::is_same_v<Protocol, tcp>) {
+                asio::error_code ec;
+                handoff.family = socket_.local_endpoint(ec).protocol() == tcp::v6() ? "tcp6" : "tcp4";
+            }
+            return handoff;
+        }
+#endif
+        return std::nullopt;
+    }
+
+    void detach() override
+    {
+        // only closes this descriptor, the connection lives on in the copy
+        asio::error_code ec;
+        socket_.close(ec);
+        timer_.cancel();
     }
 
     void deliver(Message msg) override
     {
-        logger->info("deliver: {} to {}", msg.to_string(), endpoint().address().to_string() + ":" + std::to_string(endpoint().port()));
-        write_msgs_.push_back(msg);
+        TRACE_SCOPE("Session::deliver");
+        ALLOC_SCOPE("Session::deliver");
+        auto text { msg.to_string() };
+        logger->info("deliver: {} to {}", text, endpoint().address().to_string() + ":" + std::to_string(endpoint().port()));
+        write_msgs_.push_back({ framing_.encode(text), (msg.op == OpCode::LEAVE_OP && !is_local) || msg.op == OpCode::REDIRECT_OP });
         timer_.cancel_one();
     }
 
+    void deliver_encoded(std::span<const std::string_view> msgs) override
+    {
+        logger->info("deliver: {} encoded messages to {}", msgs.size(), endpoint().address().to_string() + ":" + std::to_string(endpoint().port()));
+        Outgoing batch;
+        for (auto msg : msgs)
+            batch.data += framing_.encode(msg);
+        write_msgs_.push_back(std::move(batch));
+        timer_.cancel_one();
+    }
+    void deliver_published([[maybe_unused]] const Message& msg, std::string_view encoded) override
+    {
+        std::string_view msgs[] { encoded };
+        deliver_encoded(msgs);
+    }
+
     void stop() override
     {
         logger->debug("stop: {}:{}", endpoint().address().to_string(), std::to_string(endpoint().port()));
         logger->debug("stop: leave room");
-        room_.leave(shared_from_this());
+        room_.leave(this->shared_from_this());
         logger->debug("stop: close socket");
         socket_.close();
         logger->debug("stop: cancel timer");
@@ -681,31 +1566,90 @@ public:
     }
 
 private:
+    // queried once: a peer that already reset the connection has no address
+    // any more, and logging would otherwise make a syscall per line
+    static auto query_endpoint(const socket_type& socket, bool is_local) -> tcp::endpoint
+    {
+        asio::error_code ec;
+        if constexpr (std::is_same_v<Protocol, tcp>)
+            return is_local ? socket.local_endpoint(ec) : socket.remote_endpoint(ec);
+        else
+            // unix domain peers have no address, report them as loopback
+            return { asio::ip::address_v4::loopback(), 0 };
+    }
+
+    static auto make_framing(std::pmr::memory_resource* resource)
+    {
+        if constexpr (std::is_constructible_v<Framing, std::pmr::memory_resource*>)
+            return Framing { resource };
+        else
+            return Framing {};
+    }
+
     void shutdown()
     {
         logger->debug("shutdown: {}:{}", endpoint().address().to_string(), std::to_string(endpoint().port()));
         asio::error_code ec;
-        socket_.shutdown(tcp::socket::shutdown_both, ec);
+        socket_.shutdown(socket_type::shutdown_both, ec);
         logger->debug("shutdown: end");
     }
 
-    awaitable<void> reader()
+    // join the room once the framing handshake is done
+    awaitable<void> run()
     {
         try {
-            for (std::string read_msg;;) {
-                std::size_t n = co_await asio::async_read_until(socket_, asio::dynamic_buffer(read_msg, 1024), "\n", use_awaitable);
-                string temp = read_msg.substr(0, n);
-                logger->info("Receive Message{}", temp);
-                Message msg { read_msg.substr(0, n) };
-                room_.process_data(msg, shared_from_this());
+            co_await framing_.accept(socket_);
+        } catch (std::exception& e) {
+            logger->error("Handshake failed: {}", e.what());
+            asio::error_code ec;
+            socket_.close(ec);
+            co_return;
+        }
+        room_.join(this->shared_from_this(), resume_token_.empty());
+        if (!resume_token_.empty()) {
+            try {
+                room_.process_data({ OpCode::RESUME_OP, resume_token_ }, this->shared_from_this());
+            } catch (std::exception& e) {
+                logger->error("resume: {}", e.what());
+            }
+        }
 
-                read_msg.erase(0, n);
+        co_spawn(
+            socket_.get_executor(), [self = this->shared_from_this()] { return self->reader(); }, detached);
+
+        co_spawn(
+            socket_.get_executor(), [self = this->shared_from_this()] { return self->writer(); }, detached);
+    }
+
+    awaitable<void> reader()
+    {
+        reading_ = true;
+        try {
+            while (!paused_) {
+                auto read_msg = co_await framing_.read(socket_, [this](std::string frame) {
+                    write_msgs_.push_back({ std::move(frame) });
+                    timer_.cancel_one();
+                });
+                logger->info("Receive Message{}", read_msg);
+                Message msg;
+                {
+                    TRACE_SCOPE("Session::parse");
+                    msg = Message { read_msg };
+                }
+                room_.process_data(msg, this->shared_from_this());
             }
         } catch (std::exception& e) {
             logger->error("Exception: {}", e.what());
-            if (!is_local)
-                stop();
+            // after a pause, the new process reads on from the bytes handed over
+            if ((!is_local || Framing::local_leaves_on_close) && !paused_) {
+                // the replies go out first, e.g. the close frame of a WebSocket
+                if (write_msgs_.empty())
+                    stop();
+                else
+                    write_msgs_.back().stop = true;
+            }
         }
+        reading_ = false;
     }
 
     awaitable<void> writer()
@@ -716,66 +1660,606 @@ private:
                     asio::error_code ec;
                     co_await timer_.async_wait(redirect_error(use_awaitable, ec));
                 } else {
-                    auto msg = write_msgs_.front();
-                    co_await asio::async_write(socket_, asio::buffer(msg.to_string() + "\n"),
-                        use_awaitable);
+                    auto msg = std::move(write_msgs_.front());
                     write_msgs_.pop_front();
-                    if (msg.op == OpCode::LEAVE_OP && !is_local) {
-                        room_.leave(shared_from_this());
+                    TRACE_SCOPE("Session::write");
+                    writing_ = true;
+                    co_await asio::async_write(socket_, asio::buffer(msg.data),
+                        use_awaitable);
+                    writing_ = false;
+                    if (msg.leave) {
+                        room_.leave(this->shared_from_this());
                         shutdown();
                     }
+                    if (msg.stop)
+                        stop();
                 }
             }
         } catch (std::exception& e) {
             logger->error("Exception: {}", e.what());
-            if (!is_local)
+            if (!is_local || Framing::local_leaves_on_close)
                 stop();
         }
     }
 
     std::string name_;
-    tcp::socket socket_;
+    socket_type socket_;
     asio::steady_timer timer_;
+    tcp::endpoint endpoint_;
+    struct Outgoing {
+        std::string data;
+        // shut down the connection once this LEAVE_OP or REDIRECT_OP is written
+        bool leave {};
+        // the last reply to a peer that is gone
+        bool stop {};
+    };
+
     Room& room_;
-    std::deque<Message> write_msgs_;
+    Framing framing_;
+    std::pmr::deque<Outgoing> write_msgs_;
+    bool writing_ {};
+    bool reading_ {};
+    // stopped reading, to be handed over to another process
+    bool paused_ {};
+    std::string resume_token_;
 };
 
-void start_session(asio::io_context& io_context, Room& room, asio::error_code& ec, std::string_view ip_address, std::string_view port)
+using Session = BasicSession<tcp>;
+using WebSocketSession = BasicSession<tcp, WebSocketFraming>;
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+using LocalSession = BasicSession<asio::local::stream_protocol>;
+#endif
+
+inline auto endpoint_to_string(const tcp::endpoint& ep)
+{
+    return ep.address().to_string() + ":" + std::to_string(ep.port());
+}
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+inline auto endpoint_to_string(const asio::local::stream_protocol::endpoint& ep)
+{
+    return "unix:" + ep.path();
+}
+#endif
+
+inline Participant_ptr start_session(asio::io_context& io_context, Room& room, asio::error_code& ec, std::string_view ip_address, std::string_view port)
 {
     tcp::socket socket { io_context };
     socket.connect(tcp::endpoint(asio::ip::make_address(ip_address), stoi(port)), ec);
-    if (!ec)
-        std::make_shared<Session>(std::move(socket), room, false)->start();
+    if (ec)
+        return nullptr;
+    auto session { std::make_shared<Session>(std::move(socket), room, false) };
+    session->start();
+    return session;
 }
 
-awaitable<void> listener(tcp::acceptor acceptor, Room& room, bool is_local = false)
+inline void async_start_session(asio::io_context& io_context, Room& room, tcp::endpoint endpoint, std::function<void(const asio::error_code&, Participant_ptr)> handler)
 {
+    auto socket { std::make_shared<tcp::socket>(io_context) };
+    socket->async_connect(endpoint, [&room, socket, handler = std::move(handler)](const asio::error_code& ec) {
+        if (ec)
+            return handler(ec, nullptr);
+        auto session { std::make_shared<Session>(std::move(*socket), room, false) };
+        session->start();
+        handler(ec, session);
+    });
+}
+
+// sessions come from `pool` when given, so accepting recycles closed ones;
+// runs until `acceptor` is closed
+template <typename Framing = LineFraming, typename Acceptor>
+awaitable<void> listener(Acceptor& acceptor, Room& room, bool is_local = false, ConnectionPool* pool = nullptr)
+{
+    using Session = BasicSession<typename Acceptor::protocol_type, Framing>;
     for (;;) {
-        std::make_shared<Session>(co_await acceptor.async_accept(use_awaitable), room, is_local)->start();
-        logger->info("new connection to {}:{}", acceptor.local_endpoint().address().to_string(), acceptor.local_endpoint().port());
+        asio::error_code ec;
+        auto socket { co_await acceptor.async_accept(redirect_error(use_awaitable, ec)) };
+        if (!acceptor.is_open())
+            co_return;
+        if (ec) {
+            // e.g. a peer that reset before being accepted, or out of descriptors
+            logger->error("accept on {}: {}", endpoint_to_string(acceptor.local_endpoint()), ec.message());
+            if (ec != asio::error::connection_aborted) {
+                asio::steady_timer backoff { acceptor.get_executor(), 100ms };
+                co_await backoff.async_wait(redirect_error(use_awaitable, ec));
+            }
+            continue;
+        }
+        auto session = pool ? pool->make_shared<Session>(std::move(socket), room, is_local)
+                            : std::make_shared<Session>(std::move(socket), room, is_local);
+        session->start();
+        logger->info("new connection to {}", endpoint_to_string(acceptor.local_endpoint()));
     }
 }
 
-_EXPORT void launch_server(std::vector<asio::ip::port_type> ports)
+_EXPORT struct ServerOptions {
+    // ports[0] serves the local frontend, the others serve remote players
+    std::vector<asio::ip::port_type> ports;
+    // serve the local frontend on this unix domain socket instead of ports[0]
+    std::string local_socket;
+    // serve the local frontend over WebSocket on this port as well, 0 to disable
+    asio::ip::port_type websocket_port {};
+    // read-only HTTP API for dashboards, 0 to disable
+    asio::ip::port_type http_port {};
+    // record spans and write them as Chrome trace JSON here on SIGUSR1 and on exit
+    std::string trace_file;
+    // append all chat to this file as JSON lines
+    std::string chat_log;
+    // join the cluster described in this file as node `node_id`
+    std::string cluster_config;
+    std::string node_id;
+    // hand the server over to a new process that connects to this unix
+    // domain socket with `takeover`, then drain and exit
+    std::string upgrade_socket;
+    std::string takeover;
+#ifdef NOGO_HAS_BOT_WORKERS
+    BotPool::Options bot;
+#endif
+};
+
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+// The old side of an upgrade, see upgrade.hpp. Connections that can't be
+// handed over as they are, e.g. WebSocket, are redirected to the address
+// they connected to, now served by the new process. Returns false if the
+// upgrade was called off and the room carries on here.
+inline awaitable<bool> hand_over(asio::local::stream_protocol::socket socket, Room& room, upgrade::Listeners& listeners)
 {
+    auto frozen { room.freeze() };
+    auto transferable = [](const Participant_ptr& participant) { return dynamic_cast<upgrade::Transferable*>(participant.get()); };
+    // a session is ready once it isn't reading any more and wrote what it had
+    auto ready = [&] { return std::ranges::all_of(frozen.slots, [&](auto& slot) { auto session = transferable(slot.first); return !session || (session->pause() && session->idle()); }); };
+    auto stay = [&] {
+        room.thaw(frozen);
+        for (auto& slot : frozen.slots)
+            if (auto session = transferable(slot.first))
+                session->unpause();
+    };
+    // what is being written goes out from here, the rest is up to the new process
+    asio::steady_timer wait { socket.get_executor() };
+    for (int i = 0; i < 100 && !ready(); i++) {
+        wait.expires_after(5ms);
+        co_await wait.async_wait(use_awaitable);
+    }
+
+    socket.native_non_blocking(false);
+    auto fd { socket.native_handle() };
+    // a session still writing to a slow peer would lose the rest
+    if (!ready()) {
+        logger->warn("upgrade: sessions are still writing, staying");
+        stay();
+        upgrade::send(fd, { { "type", "abort" }, { "reason", "sessions are still writing" } });
+        co_return false;
+    }
+    // Everything goes as copies, and the new process serves nothing until it
+    // acknowledges. Until then a failure, the new process dying included,
+    // leaves the room here with its listeners and sessions.
+    std::set<Participant_ptr> handed_over;
     try {
-        asio::io_context io_context(1);
-        Room room { io_context };
+        for (auto& [name, handle] : listeners.handles())
+            upgrade::send(fd, { { "type", "listener" }, { "name", name } }, handle);
+        upgrade::send(fd, { { "type", "room" }, { "snapshot", frozen.snapshot } });
+        for (auto& [participant, slot] : frozen.slots) {
+            auto session { transferable(participant) };
+            if (!room.joined(participant) || !session)
+                continue;
+            if (auto handoff = session->handoff()) {
+                try {
+                    upgrade::send(fd, { { "type", "session" }, { "slot", slot }, { "is_local", participant->is_local }, { "family", handoff->family }, { "read_ahead", handoff->read_ahead } }, handoff->fd);
+                } catch (...) {
+                    ::close(handoff->fd);
+                    throw;
+                }
+                ::close(handoff->fd);
+                handed_over.insert(participant);
+            }
+        }
+        for (auto& [slot, msg] : room.frozen_inputs(frozen))
+            upgrade::send(fd, { { "type", "input" }, { "slot", slot }, { "message", msg.to_string() } });
+        upgrade::send(fd, { { "type", "done" } });
+        timeval timeout { 5, 0 };
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (upgrade::receive(fd).first["type"] != "ack")
+            throw std::runtime_error("upgrade: not acknowledged");
+    } catch (std::exception& e) {
+        logger->error("{}, staying", e.what());
+        stay();
+        co_return false;
+    }
+    // connections keep queueing on the sockets, and are accepted over there
+    listeners.close();
+    room.release(frozen, [&](auto& participant, auto& slot) {
+        if (handed_over.contains(participant))
+            transferable(participant)->detach();
+        else if (participant->is_local)
+            participant->deliver({ OpCode::REDIRECT_OP, endpoint_to_string(participant->endpoint()), slot });
+    });
+    logger->info("upgrade: handed over");
+    co_return true;
+}
+#endif
+
+// A connection within the process, speaking Message both ways where a
+// session speaks text over a socket. The room sees it as any participant.
+// What the room delivers is queued for receive(), or handed to `handler`
+// on the server's thread if there is one. send(), receive() and close() may
+// be called from any thread.
+_EXPORT class InProcessSession : public Participant, public std::enable_shared_from_this<InProcessSession> {
+public:
+    using Handler = std::function<void(Message)>;
+
+    InProcessSession(asio::io_context& io_context, Room& room, bool is_local, asio::ip::port_type port, Handler handler = {})
+        : Participant { is_local }
+        , io_context_ { io_context }
+        , room_ { room }
+        , endpoint_ { asio::ip::address_v4::loopback(), port }
+        , handler_ { std::move(handler) }
+    {
+    }
+
+    void start()
+    {
+        asio::post(io_context_, [self = shared_from_this()] { self->room_.join(self); });
+    }
+
+    void send(Message msg)
+    {
+        asio::post(io_context_, [self = shared_from_this(), msg = std::move(msg)]() mutable {
+            if (self->closed_)
+                return;
+            try {
+                self->room_.process_data(std::move(msg), self);
+            } catch (std::exception& e) {
+                logger->error("Exception: {}", e.what());
+                if (!self->is_local)
+                    self->stop();
+            }
+        });
+    }
+    // the next message delivered, waiting at most `timeout` for it
+    auto receive(std::chrono::steady_clock::duration timeout = {}) -> std::optional<Message>
+    {
+        std::unique_lock lock { mutex_ };
+        if (!arrived_.wait_for(lock, timeout, [this] { return !inbox_.empty(); }))
+            return std::nullopt;
+        auto msg { std::move(inbox_.front()) };
+        inbox_.pop_front();
+        return msg;
+    }
+    void close()
+    {
+        asio::post(io_context_, [self = shared_from_this()] { self->stop(); });
+    }
+    // the room has let go of this connection
+    bool closed() const { return closed_; }
+
+    std::string_view get_name() const override { return name_; }
+    void set_name(std::string_view name) override { name_ = name; }
+    tcp::endpoint endpoint() const override { return endpoint_; }
+    bool operator==(const Participant& participant) const override { return this == &participant; }
+
+    void deliver(Message msg) override
+    {
+        // as a session closes once these are written
+        auto leave { (msg.op == OpCode::LEAVE_OP && !is_local) || msg.op == OpCode::REDIRECT_OP };
+        if (handler_) {
+            handler_(std::move(msg));
+        } else {
+            {
+                std::lock_guard lock { mutex_ };
+                inbox_.push_back(std::move(msg));
+            }
+            arrived_.notify_one();
+        }
+        // not while the room is still delivering
+        if (leave)
+            close();
+    }
+    void stop() override
+    {
+        if (closed_.exchange(true))
+            return;
+        room_.leave(shared_from_this());
+    }
+
+private:
+    asio::io_context& io_context_;
+    Room& room_;
+    tcp::endpoint endpoint_;
+    std::string name_;
+    std::atomic<bool> closed_ {};
+
+    std::mutex mutex_;
+    std::condition_variable arrived_;
+    std::deque<Message> inbox_;
+    const Handler handler_;
+};
+
+// The server as an object, for embedding: it serves the listeners of its
+// options, none without ports, and connections made within the process,
+// from one io_context run on a thread of its own or on the caller's.
+_EXPORT class Server {
+public:
+    explicit Server(ServerOptions options = {})
+        : options_ { std::move(options) }
+        , room_ { io_context_ }
+    {
+    }
+    Server(const Server&) = delete;
+    ~Server()
+    {
+        stop();
+    }
+
+    // throws if a listener can't be opened
+    void start()
+    {
+        open();
+        thread_ = std::jthread { [this] { serve(); } };
+    }
+    // serves on this thread until stop()
+    void run()
+    {
+        open();
+        serve();
+    }
+    // from any thread
+    void stop()
+    {
+        io_context_.stop();
+        if (thread_.joinable() && thread_.get_id() != std::this_thread::get_id())
+            thread_.join();
+        api_context_.stop();
+        if (api_thread_.joinable() && api_thread_.get_id() != std::this_thread::get_id())
+            api_thread_.join();
+    }
+
+    auto io_context() -> asio::io_context& { return io_context_; }
+    // only to be touched on the server's thread
+    auto room() -> Room& { return room_; }
+
+    // a connection as the local frontend, or as a remote player; what the
+    // room delivers goes to `handler` if given, from the first message on,
+    // and otherwise waits for receive()
+    auto connect(bool is_local = true, InProcessSession::Handler handler = {}) -> std::shared_ptr<InProcessSession>
+    {
+        auto session { std::make_shared<InProcessSession>(io_context_, room_, is_local, next_port_++, std::move(handler)) };
+        session->start();
+        return session;
+    }
 
-        tcp::endpoint local { tcp::v4(), ports[0] };
-        co_spawn(io_context, listener(tcp::acceptor(io_context, local), room, true), detached);
-        logger->info("Serving on {}:{}", local.address().to_string(), local.port());
-        for (auto port : ports | std::views::drop(1)) {
+private:
+    void open()
+    {
+        auto& options { options_ };
+        auto& ports { options.ports };
+        if (!options.chat_log.empty()) {
+            chat_log_.emplace(options.chat_log);
+            room_.set_chat_log(std::addressof(*chat_log_));
+        }
+        // the process being upgraded hands over its sockets and room
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+        if (!options.takeover.empty())
+            inherited_ = upgrade::take_over(options.takeover);
+        listeners_.emplace(io_context_, std::move(inherited_.listeners));
+#else
+        if (!options.takeover.empty())
+            throw std::runtime_error("upgrades are not supported on this platform");
+        listeners_.emplace(io_context_);
+#endif
+        auto& listeners { *listeners_ };
+        if (!options.cluster_config.empty()) {
+            auto config { cluster::Config::load(options.cluster_config) };
+            // the link is for the other nodes, on the address they dial
+            auto& node { config.node(options.node_id) };
+            auto link_endpoint { tcp::resolver { io_context_ }.resolve(node.host, std::to_string(node.link_port))->endpoint() };
+            auto& link { listeners.open<tcp::acceptor>("link", link_endpoint) };
+            cluster_.emplace(io_context_, std::move(config), options.node_id, link);
+            room_.set_cluster(std::addressof(*cluster_));
+        }
+#ifdef NOGO_HAS_BOT_WORKERS
+        if (options.bot.workers) {
+            bot_pool_.emplace(io_context_, options.bot);
+            room_.set_bot_pool(std::addressof(*bot_pool_));
+        }
+#endif
+
+        // without a unix domain socket for the frontend, ports[0] is the local one
+        auto remote_ports { ports | std::views::drop(options.local_socket.empty() && !ports.empty() ? 1 : 0) };
+        if (!options.local_socket.empty()) {
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+            asio::local::stream_protocol::endpoint local { options.local_socket };
+            co_spawn(io_context_, listener(listeners.open<asio::local::stream_protocol::acceptor>("local", local), room_, true, &pool_), detached);
+            logger->info("Serving on {}", endpoint_to_string(local));
+#else
+            throw std::runtime_error("unix domain sockets are not supported on this platform");
+#endif
+        } else if (!ports.empty()) {
+            tcp::endpoint local { tcp::v4(), ports[0] };
+            co_spawn(io_context_, listener(listeners.open<tcp::acceptor>("local", local), room_, true, &pool_), detached);
+            logger->info("Serving on {}:{}", local.address().to_string(), local.port());
+        }
+        if (options.websocket_port) {
+            tcp::endpoint ep { tcp::v4(), options.websocket_port };
+            co_spawn(io_context_, listener<WebSocketFraming>(listeners.open<tcp::acceptor>("websocket", ep), room_, true, &pool_), detached);
+            logger->info("Serving WebSocket on {}:{}", ep.address().to_string(), ep.port());
+        }
+        if (options.http_port) {
+            // the API has a thread of its own: the room hands it snapshots and
+            // finished games, and never waits on a request
+            enum { page_size = 50 };
+            room_.set_summary(&room_summary_);
+            room_.set_archive([this](GameRecord record) {
+                asio::post(api_context_, [this, record = std::move(record)]() mutable { archive_.add(std::move(record)); });
+            });
+            api_.route("/rooms", [this] { return room_summary_.version(); }, [this](auto path, auto) -> std::optional<json> {
+                if (!path.empty())
+                    return std::nullopt;
+                return json::array({ *room_summary_.get() });
+            });
+            api_.route("/leaderboard", [this] { return archive_.version(); }, [this](auto path, auto page) -> std::optional<json> {
+                if (!path.empty())
+                    return std::nullopt;
+                return archive_.leaderboard(page, page_size);
+            });
+            api_.route("/games", [this] { return archive_.version(); }, [this](auto path, auto page) -> std::optional<json> {
+                if (path.empty())
+                    return archive_.games(page, page_size);
+                std::uint64_t id {};
+                std::from_chars(path.data() + 1, path.data() + path.size(), id);
+                if (auto record = archive_.record(id))
+                    return json(*record);
+                return std::nullopt;
+            });
+            api_.route("/metrics", [] { return metrics.version(); }, [](auto path, auto) -> std::optional<json> {
+                if (!path.empty())
+                    return std::nullopt;
+                return metrics.snapshot();
+            });
+            tcp::endpoint ep { tcp::v4(), options.http_port };
+            co_spawn(api_context_, http_listener(listeners.open<tcp::acceptor>("http", ep, &api_context_), api_), detached);
+            api_thread_ = std::jthread { [this] { api_context_.run(); } };
+            logger->info("Serving HTTP on {}:{}", ep.address().to_string(), ep.port());
+        }
+        for (auto port : remote_ports) {
             tcp::endpoint ep { tcp::v4(), port };
-            co_spawn(io_context, listener(tcp::acceptor(io_context, ep), room), detached);
+            co_spawn(io_context_, listener(listeners.open<tcp::acceptor>("remote:" + std::to_string(port), ep), room_, false, &pool_), detached);
             logger->info("Serving on {}:{}", ep.address().to_string(), ep.port());
         }
 
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+        if (!inherited_.room.empty()) {
+            if (auto error = room_.restore("upgrade", inherited_.room); !error.empty())
+                logger->error("upgrade: room not restored: {}", error);
+            for (auto& [slot, msg] : inherited_.inputs)
+                room_.receive_migrated_input("upgrade", slot, Message { msg });
+        }
+        for (auto& inherited_session : inherited_.sessions) {
+            auto resume = [&](auto session) {
+                session->resume(inherited_session.slot, inherited_session.handoff.read_ahead);
+                session->start();
+            };
+            auto fd { inherited_session.handoff.fd };
+            if (inherited_session.handoff.family == "unix")
+                resume(pool_.make_shared<LocalSession>(asio::local::stream_protocol::socket { io_context_, asio::local::stream_protocol {}, fd }, room_, inherited_session.is_local));
+            else
+                resume(pool_.make_shared<Session>(tcp::socket { io_context_, inherited_session.handoff.family == "tcp6" ? tcp::v6() : tcp::v4(), fd }, room_, inherited_session.is_local));
+        }
+        if (!options.upgrade_socket.empty()) {
+            auto& acceptor { listeners.open<asio::local::stream_protocol::acceptor>("upgrade", { options.upgrade_socket }) };
+            co_spawn(io_context_, [this, &acceptor]() -> awaitable<void> {
+                try {
+                    // an upgrade called off can be tried again
+                    while (!co_await hand_over(co_await acceptor.async_accept(use_awaitable), room_, *listeners_)) { }
+                } catch (std::exception& e) {
+                    logger->error("upgrade: {}", e.what());
+                    co_return;
+                }
+                // let the last writes and redirects go out
+                asio::steady_timer drain { io_context_, 1s };
+                co_await drain.async_wait(use_awaitable);
+                io_context_.stop();
+            }, detached);
+            logger->info("Waiting for upgrades on {}", options.upgrade_socket);
+        }
+#else
+        if (!options.upgrade_socket.empty())
+            throw std::runtime_error("upgrades are not supported on this platform");
+#endif
+
+        trace::enabled = !options.trace_file.empty();
+    }
+
+    void serve()
+    {
+        try {
+            io_context_.run();
+        } catch (std::exception& e) {
+            logger->error("Exception: {}", e.what());
+        }
+    }
+
+    ServerOptions options_;
+    // declared before the io_context, which destroys the last sessions
+    ConnectionPool pool_;
+    asio::io_context io_context_ { 1 };
+    // served until stopped, even without a listener
+    asio::executor_work_guard<asio::io_context::executor_type> work_ { io_context_.get_executor() };
+    Room room_;
+    std::optional<ChatLog> chat_log_;
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+    upgrade::Inheritance inherited_;
+#endif
+    std::optional<upgrade::Listeners> listeners_;
+    std::optional<cluster::Cluster> cluster_;
+#ifdef NOGO_HAS_BOT_WORKERS
+    std::optional<BotPool> bot_pool_;
+#endif
+    std::atomic<asio::ip::port_type> next_port_ { 1 };
+    std::jthread thread_;
+    // the HTTP API and what it serves, on a thread of its own
+    asio::io_context api_context_ { 1 };
+    asio::executor_work_guard<asio::io_context::executor_type> api_work_ { api_context_.get_executor() };
+    GameArchive archive_;
+    Snapshot<json> room_summary_;
+    HttpApi api_;
+    std::jthread api_thread_;
+};
+
+// the server of the nogo binary, until SIGINT or SIGTERM
+_EXPORT inline void launch_server(const ServerOptions& options)
+{
+    try {
+        Server server { options };
+        auto& io_context { server.io_context() };
+        auto& room { server.room() };
+
         asio::signal_set signals(io_context, SIGINT, SIGTERM);
         signals.async_wait([&](auto, auto) { io_context.stop(); });
 
-        io_context.run();
+#ifdef SIGUSR2
+        // before a rolling restart: move the room to another node
+        asio::signal_set migrate_signals(io_context);
+        std::function<void(const asio::error_code&, int)> migrate = [&](auto ec, auto) {
+            if (ec)
+                return;
+            try {
+                room.migrate([](auto error) {
+                    if (error.empty())
+                        logger->info("room migrated, this node can be stopped");
+                    else
+                        logger->error("room not migrated: {}", error);
+                });
+            } catch (std::exception& e) {
+                logger->error("migrate: {}", e.what());
+            }
+            migrate_signals.async_wait(migrate);
+        };
+        if (!options.cluster_config.empty()) {
+            migrate_signals.add(SIGUSR2);
+            migrate_signals.async_wait(migrate);
+        }
+#endif
+
+#ifdef SIGUSR1
+        asio::signal_set dump_signals(io_context, SIGUSR1);
+        std::function<void(const asio::error_code&, int)> dump_trace = [&](auto ec, auto) {
+            if (ec)
+                return;
+            if (trace::enabled)
+                logger->info("trace written to {}: {}", options.trace_file, trace::dump(options.trace_file));
+            dump_signals.async_wait(dump_trace);
+        };
+        dump_signals.async_wait(dump_trace);
+#endif
+
+        server.run();
+        if (trace::enabled)
+            trace::dump(options.trace_file);
     } catch (std::exception& e) {
         logger->error("Exception: {}", e.what());
     }
+}
+
+_EXPORT inline void launch_server(std::vector<asio::ip::port_type> ports)
+{
+    launch_server(ServerOptions { ports });
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include "solver.hpp"
+
+// Solves No-go on a small board and writes the table of its perfect play, or
+// plays perfectly from such a table over stdin and stdout.
+//
+//   nogo-solve <size> [--threads <n>] [--endgame <empty points>] [--out <table>]
+//   nogo-solve <size> --play <table>
+
+auto peak_memory_mib()
+{
+#ifdef __linux__
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+#else
+    return 0.0;
+#endif
+}
+
+template <int N>
+auto solve(unsigned threads, int endgame, const std::string& out) -> int
+{
+    solver::Solver<N> solver { threads, endgame };
+    auto start { std::chrono::steady_clock::now() };
+    auto black_wins { solver.solve({}) };
+    auto solved { std::chrono::steady_clock::now() };
+    auto table { solver.table({}) };
+    std::chrono::duration<double> solve_time { solved - start }, table_time { std::chrono::steady_clock::now() - solved };
+    std::printf("%dx%d: %s wins\n", N, N, black_wins ? "black, the first player," : "white, the second player,");
+    std::printf("solved in %.2fs with %u threads: %llu nodes, %zu positions in the transposition table\n",
+        solve_time.count(), threads, static_cast<unsigned long long>(solver.nodes()), solver.entries());
+    std::printf("table of %zu positions, %zu bytes, built in %.2fs\n", table.size(), table.bytes(), table_time.count());
+    std::printf("peak memory %.1f MiB\n", peak_memory_mib());
+    if (!out.empty())
+        table.save(out);
+    return 0;
+}
+
+template <int N>
+auto play(const std::string& path) -> int
+{
+    using Position = solver::Position<N>;
+    solver::TableBot<N> bot { solver::Table<N>::load(path) };
+    // the table proves one side, the bot takes it
+    auto bot_is_black { bot.play({}).has_value() && solver::Table<N>::load(path).move({}).has_value() };
+    std::printf("bot plays %s, moves are like A1\n", bot_is_black ? "black" : "white");
+    Position position;
+    for (bool black_to_move = true;; black_to_move = !black_to_move) {
+        if (!position.moves()) {
+            std::printf("%s has no move left and loses\n", black_to_move ? "black" : "white");
+            return 0;
+        }
+        if (black_to_move == bot_is_black) {
+            auto start { std::chrono::steady_clock::now() };
+            auto move { *bot.play(position) };
+            std::chrono::duration<double, std::micro> elapsed { std::chrono::steady_clock::now() - start };
+            std::printf("bot: %s (%.0fus)\n", Position::name(move).c_str(), elapsed.count());
+            position = position.play(move);
+            continue;
+        }
+        for (std::string line;;) {
+            if (!std::getline(std::cin, line))
+                return 0;
+            if (auto move = Position::parse(line); move && position.legal(*move)) {
+                position = position.play(*move);
+                break;
+            }
+            std::printf("not a legal move: %s\n", line.c_str());
+        }
+    }
+}
+
+template <int N>
+auto run(unsigned threads, int endgame, const std::string& out, const std::string& table) -> int
+{
+    return table.empty() ? solve<N>(threads, endgame, out) : play<N>(table);
+}
+
+auto main(int argc, char* argv[]) -> int
+{
+    if (argc < 2) {
+        std::cerr << "Usage: nogo-solve <size> [--threads <n>] [--endgame <empty points>] [--out <table>] [--play <table>]\n";
+        return 1;
+    }
+    auto size { std::atoi(argv[1]) };
+    unsigned threads { std::max(1u, std::thread::hardware_concurrency()) };
+    int endgame {};
+    std::string out, table;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string_view key { argv[i] };
+        if (key == "--threads")
+            threads = std::max(1, std::atoi(argv[i + 1]));
+        else if (key == "--endgame")
+            endgame = std::atoi(argv[i + 1]);
+        else if (key == "--out")
+            out = argv[i + 1];
+        else if (key == "--play")
+            table = argv[i + 1];
+    }
+    try {
+        switch (size) {
+        case 2:
+            return run<2>(threads, endgame, out, table);
+        case 3:
+            return run<3>(threads, endgame, out, table);
+        case 4:
+            return run<4>(threads, endgame, out, table);
+        case 5:
+            return run<5>(threads, endgame, out, table);
+        case 6:
+            return run<6>(threads, endgame, out, table);
+        default:
+            std::cerr << "sizes from 2 to 6 can be solved\n";
+            return 1;
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,556 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "cgt.hpp"
+
+// Exact solutions of No-go on small boards, to check the engine and the bots
+// against perfect play. The rest of the engine is built for 9x9, so positions
+// here are N x N bitboards of their own, with points numbered as in rule.hpp:
+// x * N + y, named by a letter for x and a digit for y.
+//
+// 2x2 and 3x3 are first-player wins and 4x4 is a second-player win, solved in
+// seconds. 5x5 and 6x6 are out of reach of this solver: the transposition
+// table has no size bound, and on one core with 5 GiB a 5x5 solve ran 25
+// minutes and grew past 3 GiB without finishing. Solving them would take a
+// bounded table with a replacement policy and more cores than that.
+namespace solver {
+
+template <int N>
+class Position {
+public:
+    static_assert(N >= 2 && N <= 6, "positions are keyed in base 3 in 64 bits");
+    static constexpr int points = N * N;
+    using Bits = std::uint64_t;
+    static constexpr Bits full = (Bits { 1 } << points) - 1;
+
+    // stones of the side to move, and of the other side
+    Bits own {}, opp {};
+
+    static constexpr auto neighbors(Bits b) -> Bits
+    {
+        return ((b << 1 & ~column(0)) | (b >> 1 & ~column(N - 1)) | b << N | b >> N) & full;
+    }
+    static constexpr auto flood(Bits seed, Bits within) -> Bits
+    {
+        for (auto next { seed }; (next = (seed | neighbors(seed)) & within) != seed;)
+            seed = next;
+        return seed;
+    }
+
+    // neither suicide nor capture
+    constexpr bool legal(int p) const
+    {
+        auto bit { Bits { 1 } << p };
+        if ((own | opp) & bit)
+            return false;
+        auto mine { own | bit };
+        auto empty { full & ~(mine | opp) };
+        if (!(neighbors(flood(bit, mine)) & empty))
+            return false;
+        for (auto adjacent { neighbors(bit) & opp }; adjacent;) {
+            auto group { flood(adjacent & -adjacent, opp) };
+            if (!(neighbors(group) & empty))
+                return false;
+            adjacent &= ~group;
+        }
+        return true;
+    }
+    constexpr auto moves() const -> Bits
+    {
+        Bits res {};
+        for (auto empty { full & ~(own | opp) }; empty; empty &= empty - 1)
+            if (auto p = std::countr_zero(empty); legal(p))
+                res |= Bits { 1 } << p;
+        return res;
+    }
+    constexpr auto play(int p) const -> Position { return { opp, own | Bits { 1 } << p }; }
+
+    // where point `p` goes under symmetry `k`, the same 8 as in rule.hpp
+    static constexpr auto map(int p, int k) -> int
+    {
+        constexpr int last { N - 1 };
+        int x { p / N }, y { p % N };
+        std::array<std::pair<int, int>, 8> images { { { x, y }, { y, last - x }, { last - x, last - y }, { last - y, x },
+            { last - x, y }, { y, x }, { x, last - y }, { last - y, last - x } } };
+        return images[k].first * N + images[k].second;
+    }
+    static constexpr auto inverse(int k) { return k == 1 ? 3 : k == 3 ? 1 : k; }
+
+    // The key of the position, the same for its 8 symmetric images, and the
+    // symmetry taking the position to the image the key stands for. Keys are
+    // the points in base 3, so they order positions and decode back.
+    constexpr auto canonical() const -> std::pair<std::uint64_t, int>
+    {
+        std::pair res { std::numeric_limits<std::uint64_t>::max(), 0 };
+        for (int k = 0; k < 8; k++) {
+            std::uint64_t key {};
+            for (int c = 0; c < chunks; c++)
+                key += digits[k][c][own >> (8 * c) & 0xff] + 2 * digits[k][c][opp >> (8 * c) & 0xff];
+            res = std::min(res, { key, k });
+        }
+        return res;
+    }
+    static constexpr auto decode(std::uint64_t key) -> Position
+    {
+        Position res;
+        for (int p = 0; p < points; p++, key /= 3)
+            (key % 3 == 1 ? res.own : res.opp) |= key % 3 ? Bits { 1 } << p : 0;
+        return res;
+    }
+
+    static auto name(int p) -> std::string { return { static_cast<char>('A' + p / N), static_cast<char>('1' + p % N) }; }
+    static auto parse(std::string_view name) -> std::optional<int>
+    {
+        if (name.size() != 2 || name[0] < 'A' || name[0] >= 'A' + N || name[1] < '1' || name[1] >= '1' + N)
+            return std::nullopt;
+        return (name[0] - 'A') * N + name[1] - '1';
+    }
+
+private:
+    static constexpr auto column(int y) -> Bits
+    {
+        Bits res {};
+        for (int x = 0; x < N; x++)
+            res |= Bits { 1 } << (x * N + y);
+        return res;
+    }
+    // The base 3 digits, under symmetry k, of the points set in each byte of
+    // a bitboard, so that a key takes a lookup per byte instead of a step per
+    // point.
+    static constexpr int chunks = (points + 7) / 8;
+    static constexpr auto digits = [] {
+        std::array<std::uint64_t, points> powers {};
+        for (std::uint64_t p = 0, power = 1; p < points; p++, power *= 3)
+            powers[p] = power;
+        std::array<std::array<std::array<std::uint64_t, 256>, chunks>, 8> res {};
+        for (int k = 0; k < 8; k++)
+            for (int c = 0; c < chunks; c++)
+                for (int v = 0; v < 256; v++)
+                    for (int i = 0; i < 8 && 8 * c + i < points; i++)
+                        if (v >> i & 1)
+                            res[k][c][v] += powers[map(8 * c + i, k)];
+        return res;
+    }();
+};
+
+// A position by color, as cgt.hpp values it: Black is the side to move of
+// the position it was made from. Regions are closed over the groups around
+// them as in rule.hpp.
+template <int N>
+class Stones {
+public:
+    using Bits = typename Position<N>::Bits;
+
+    struct Set {
+        Bits bits {};
+
+        constexpr auto count() const { return std::popcount(bits); }
+        // the point of lowest index, the set must not be empty
+        constexpr auto first() const { return std::countr_zero(bits); }
+        constexpr bool test(int p) const { return bits >> p & 1; }
+        constexpr void reset(int p) { bits &= ~(Bits { 1 } << p); }
+        constexpr explicit operator bool() const { return bits; }
+        constexpr bool operator==(const Set&) const = default;
+        constexpr auto operator&(Set s) const -> Set { return { bits & s.bits }; }
+    };
+    struct Region {
+        Set empty, stones;
+    };
+
+    explicit constexpr Stones(const Position<N>& position)
+        : black_ { position.own }
+        , white_ { position.opp }
+    {
+    }
+
+    constexpr auto stones(Role role) const -> Set { return { role == Role::BLACK ? black_ : white_ }; }
+    constexpr auto empty() const -> Set { return { Position<N>::full & ~(black_ | white_) }; }
+
+    constexpr auto play(int p, Role role) const -> std::optional<Stones>
+    {
+        auto black { role == Role::BLACK };
+        if (!Position<N> { black ? black_ : white_, black ? white_ : black_ }.legal(p))
+            return std::nullopt;
+        auto res { *this };
+        (black ? res.black_ : res.white_) |= Bits { 1 } << p;
+        return res;
+    }
+
+    // the independent regions of the empty points in `within`
+    auto regions(Set within = { Position<N>::full }) const
+    {
+        auto empty { this->empty().bits & within.bits };
+        std::vector<Region> res;
+        for (auto rest { empty }; rest; rest &= ~res.back().empty.bits) {
+            Bits area { rest & -rest }, stones {};
+            for (;;) {
+                area = Position<N>::flood(area, empty);
+                auto next { Position<N>::neighbors(area) };
+                stones = Position<N>::flood(next & black_, black_) | Position<N>::flood(next & white_, white_);
+                auto liberties { Position<N>::neighbors(stones) & empty };
+                if (!(liberties & ~area))
+                    break;
+                area |= liberties;
+            }
+            res.push_back({ { area }, { stones } });
+        }
+        return res;
+    }
+
+private:
+    Bits black_, white_;
+};
+
+// Perfect play from a solved position: for every position of the proof where
+// the winner is to move, its winning move, keyed by canonical position. Where
+// the loser is to move every move is covered, so a winner reading the table
+// always finds its move. Entries are 9 bytes, sorted by key.
+_EXPORT template <int N>
+class Table {
+public:
+    struct Entry {
+        std::uint64_t key;
+        std::uint8_t move;
+        auto operator<=>(const Entry&) const = default;
+    };
+
+    Table() = default;
+    explicit Table(std::vector<Entry> entries)
+        : entries_ { std::move(entries) }
+    {
+        std::ranges::sort(entries_);
+    }
+
+    auto move(const Position<N>& position) const -> std::optional<int>
+    {
+        auto [key, k] = position.canonical();
+        auto it { std::ranges::lower_bound(entries_, key, {}, &Entry::key) };
+        if (it == entries_.end() || it->key != key)
+            return std::nullopt;
+        return Position<N>::map(it->move, Position<N>::inverse(k));
+    }
+    auto size() const { return entries_.size(); }
+    auto bytes() const { return entries_.size() * (sizeof(std::uint64_t) + 1); }
+
+    // "NOGOTBL", N, the entry count and the entries, little-endian
+    void save(const std::string& path) const
+    {
+        std::ofstream out { path, std::ios::binary };
+        out.write("NOGOTBL", 7).put(static_cast<char>(N));
+        put(out, entries_.size());
+        for (auto& entry : entries_)
+            put(out, entry.key), out.put(static_cast<char>(entry.move));
+        if (!out)
+            throw std::runtime_error("can't write " + path);
+    }
+    static auto load(const std::string& path) -> Table
+    {
+        std::ifstream in { path, std::ios::binary };
+        char magic[8] {};
+        if (!in.read(magic, 8) || std::string_view { magic, 7 } != "NOGOTBL" || magic[7] != N)
+            throw std::runtime_error(path + " is not a " + std::to_string(N) + "x" + std::to_string(N) + " table");
+        std::vector<Entry> entries(get(in));
+        for (auto& entry : entries)
+            entry = { get(in), static_cast<std::uint8_t>(in.get()) };
+        if (!in)
+            throw std::runtime_error(path + " is truncated");
+        return Table { std::move(entries) };
+    }
+
+private:
+    static void put(std::ostream& out, std::uint64_t v)
+    {
+        for (int i = 0; i < 8; i++)
+            out.put(static_cast<char>(v >> (8 * i)));
+    }
+    static auto get(std::istream& in) -> std::uint64_t
+    {
+        std::uint64_t v {};
+        for (int i = 0; i < 8; i++)
+            v |= static_cast<std::uint64_t>(static_cast<unsigned char>(in.get())) << (8 * i);
+        return v;
+    }
+
+    std::vector<Entry> entries_;
+};
+
+// Depth-first proof-number search, in negamax form: a node's proof number is
+// the cost of showing the side to move wins, its disproof number that of
+// showing it loses. Positions are shared between symmetric images in a
+// transposition table split into locked shards, and the moves of the root
+// are searched by all threads at once.
+//
+// Once at most `endgame` points are empty, cgt.hpp helps: a position split
+// into regions of at most `endgame_region` empty points is solved from their
+// values, and the moves it finds dominated are not tried for a winning one.
+// That searches fewer nodes, but on the boards solved here valuing regions
+// costs more than it saves, so it is off unless asked for.
+_EXPORT template <int N>
+class Solver {
+public:
+    using Position = solver::Position<N>;
+    static constexpr int endgame_region = 6;
+
+    explicit Solver(unsigned threads = std::max(1u, std::thread::hardware_concurrency()), int endgame = 0)
+        : threads_ { threads }
+        , endgame_ { endgame }
+    {
+    }
+
+    // whether the side to move wins
+    bool solve(const Position& root)
+    {
+        auto moves { root.moves() };
+        std::vector<Position> children;
+        for (auto rest { moves }; rest; rest &= rest - 1)
+            children.push_back(root.play(std::countr_zero(rest)));
+        std::atomic<std::size_t> next {};
+        {
+            std::vector<std::jthread> workers;
+            for (unsigned i = 0; i < threads_; i++)
+                workers.emplace_back([&] {
+                    for (std::size_t j; (j = next++) < children.size();)
+                        prove(children[j]);
+                });
+        }
+        prove(root);
+        return lookup(root.canonical().first).phi == 0;
+    }
+
+    // a winning move, none if the side to move loses
+    auto winning_move(const Position& position) -> std::optional<int>
+    {
+        for (auto move : candidates(position)) {
+            auto child { position.play(move) };
+            if (prove(child), lookup(child.canonical().first).delta == 0)
+                return move;
+        }
+        return std::nullopt;
+    }
+
+    // the proof of `root` as a table
+    auto table(const Position& root) -> Table<N>
+    {
+        std::vector<typename Table<N>::Entry> entries;
+        std::unordered_set<std::uint64_t> visited;
+        std::vector<Position> stack { root };
+        while (!stack.empty()) {
+            auto position { stack.back() };
+            stack.pop_back();
+            auto [key, k] = position.canonical();
+            if (!visited.insert(key).second)
+                continue;
+            if (auto move = winning_move(position)) {
+                entries.push_back({ key, static_cast<std::uint8_t>(Position::map(*move, k)) });
+                stack.push_back(position.play(*move));
+            } else {
+                for (auto rest { position.moves() }; rest; rest &= rest - 1)
+                    stack.push_back(position.play(std::countr_zero(rest)));
+            }
+        }
+        return Table<N> { std::move(entries) };
+    }
+
+    auto nodes() const { return nodes_.load(); }
+    auto entries() const
+    {
+        std::size_t res {};
+        for (auto& shard : shards_) {
+            std::lock_guard lock { shard.mutex };
+            res += shard.map.size();
+        }
+        return res;
+    }
+
+private:
+    struct Numbers {
+        std::uint32_t phi { 1 }, delta { 1 };
+    };
+    static constexpr std::uint32_t inf = std::numeric_limits<std::uint32_t>::max() / 2;
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::uint64_t, Numbers> map;
+    };
+
+    auto shard(std::uint64_t key) -> Shard& { return shards_[(key * 0x9e3779b97f4a7c15) >> 58]; }
+    auto lookup(std::uint64_t key) -> Numbers
+    {
+        auto& shard { this->shard(key) };
+        std::lock_guard lock { shard.mutex };
+        auto it { shard.map.find(key) };
+        return it == shard.map.end() ? Numbers {} : it->second;
+    }
+    void store(std::uint64_t key, Numbers numbers)
+    {
+        auto& shard { this->shard(key) };
+        std::lock_guard lock { shard.mutex };
+        shard.map[key] = numbers;
+    }
+    // A position seen for the first time: one move may be enough to win, and
+    // every move has to be answered to lose, which makes positions with few
+    // moves the cheapest to disprove.
+    void initialize(std::uint64_t key, const Position& position)
+    {
+        auto& shard { this->shard(key) };
+        {
+            std::lock_guard lock { shard.mutex };
+            if (shard.map.contains(key))
+                return;
+        }
+        auto moves { std::popcount(position.moves()) };
+        std::lock_guard lock { shard.mutex };
+        shard.map.try_emplace(key, moves ? Numbers { 1, static_cast<std::uint32_t>(moves) } : Numbers { inf, 0 });
+    }
+
+    void prove(const Position& position)
+    {
+        auto key { position.canonical().first };
+        while (true) {
+            auto numbers { lookup(key) };
+            if (numbers.phi == 0 || numbers.delta == 0)
+                return;
+            search(position, key, inf, inf);
+        }
+    }
+
+    // one per thread, the values of regions hold for any position
+    static auto evaluator() -> cgt::Evaluator<Stones<N>>&
+    {
+        static thread_local cgt::Evaluator<Stones<N>> res { endgame_region };
+        return res;
+    }
+    auto in_endgame(const Position& position) const
+    {
+        return Position::points - std::popcount(position.own | position.opp) <= endgame_;
+    }
+
+    // Whether the side to move wins, as cgt.hpp finds from the value of each
+    // region, none if it can't tell. Searching a single region as a game costs
+    // more than searching its moves, so only positions that have split are
+    // valued.
+    auto endgame_winner(const Position& position) -> std::optional<bool>
+    {
+        if (!in_endgame(position))
+            return std::nullopt;
+        Stones<N> stones { position };
+        if (stones.regions().size() < 2)
+            return std::nullopt;
+        if (auto winner = evaluator().winner(stones, Role::BLACK))
+            return *winner == Role::BLACK;
+        return std::nullopt;
+    }
+
+    // the moves a winning one is among: in the endgame, those cgt.hpp doesn't
+    // find dominated
+    auto candidates(const Position& position) -> std::vector<int>
+    {
+        std::vector<int> res;
+        for (auto rest { position.moves() }; rest; rest &= rest - 1)
+            res.push_back(std::countr_zero(rest));
+        if (in_endgame(position))
+            res.resize(evaluator().order(Stones<N> { position }, Role::BLACK, res));
+        return res;
+    }
+
+    void search(const Position& position, std::uint64_t key, std::uint32_t phi_limit, std::uint32_t delta_limit)
+    {
+        nodes_.fetch_add(1, std::memory_order_relaxed);
+        if (auto wins = endgame_winner(position)) {
+            store(key, *wins ? Numbers { 0, inf } : Numbers { inf, 0 });
+            return;
+        }
+        std::array<std::pair<Position, std::uint64_t>, Position::points> children;
+        std::size_t size {};
+        for (auto rest { position.moves() }; rest; rest &= rest - 1) {
+            auto child { position.play(std::countr_zero(rest)) };
+            children[size++] = { child, child.canonical().first };
+            initialize(children[size - 1].second, child);
+        }
+        // no move left, the side to move has lost
+        if (!size) {
+            store(key, { inf, 0 });
+            return;
+        }
+        for (;;) {
+            // the side to move wins through its best child, and loses once
+            // every child is a win for the other side
+            std::uint64_t phi { inf }, delta {}, second { inf };
+            std::size_t best {};
+            for (std::size_t i = 0; i < size; i++) {
+                auto child { lookup(children[i].second) };
+                if (child.delta < phi)
+                    second = phi, phi = child.delta, best = i;
+                else if (child.delta < second)
+                    second = child.delta;
+                // a child the other side has lost can't be disproved, and no
+                // sum of estimates reaches that
+                if (delta < inf)
+                    delta = child.phi >= inf ? inf : std::min<std::uint64_t>(inf - 1, delta + child.phi);
+            }
+            store(key, { static_cast<std::uint32_t>(phi), static_cast<std::uint32_t>(delta) });
+            if (phi >= phi_limit || delta >= delta_limit)
+                return;
+            auto child { lookup(children[best].second) };
+            auto child_phi_limit { std::min<std::uint64_t>(inf, delta_limit - delta + child.phi) };
+            // a little past the second best child, so that the search doesn't
+            // flip between two close ones
+            auto child_delta_limit { std::min<std::uint64_t>(phi_limit, second + second / 4 + 1) };
+            search(children[best].first, children[best].second, static_cast<std::uint32_t>(child_phi_limit), static_cast<std::uint32_t>(child_delta_limit));
+        }
+    }
+
+    unsigned threads_;
+    int endgame_;
+    std::array<Shard, 64> shards_;
+    std::atomic<std::uint64_t> nodes_ {};
+};
+
+// Plays from a table, solving positions it doesn't cover, which only happens
+// to the side the table proves lost, once the other side errs.
+_EXPORT template <int N>
+class TableBot {
+public:
+    explicit TableBot(Table<N> table)
+        : table_ { std::move(table) }
+    {
+    }
+
+    // none if there is no legal move
+    auto play(const Position<N>& position) -> std::optional<int>
+    {
+        if (auto move = table_.move(position))
+            return move;
+        if (auto move = solver_.winning_move(position))
+            return move;
+        if (auto moves = position.moves())
+            return std::countr_zero(moves);
+        return std::nullopt;
+    }
+
+private:
+    Table<N> table_;
+    Solver<N> solver_ { 1 };
+};
+
+}
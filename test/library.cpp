@@ -0,0 +1,30 @@
+// Every header of libnogo in a translation unit of its own, linked with
+// test.cpp: a definition in them that isn't inline fails to link, as it
+// would in any program that embeds the server in more than one file.
+#include "../alloc.hpp"
+#include "../archive.hpp"
+#include "../bot.hpp"
+#include "../botpool.hpp"
+#include "../botproto.hpp"
+#include "../cgt.hpp"
+#include "../chat.hpp"
+#include "../clock.hpp"
+#include "../cluster.hpp"
+#include "../contest.hpp"
+#include "../http.hpp"
+#include "../lobby.hpp"
+#include "../log.hpp"
+#include "../message.hpp"
+#include "../metrics.hpp"
+#include "../migration.hpp"
+#include "../network.hpp"
+#include "../packed.hpp"
+#include "../pool.hpp"
+#include "../pubsub.hpp"
+#include "../rule.hpp"
+#include "../server.hpp"
+#include "../solver.hpp"
+#include "../trace.hpp"
+#include "../uimessage.hpp"
+#include "../upgrade.hpp"
+#include "../websocket.hpp"
@@ -1,10 +1,16 @@
 #include <algorithm>
 #include <charconv>
 #include <deque>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <map>
+#include <optional>
+#include <random>
 #include <sstream>
 #include <string_view>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #ifdef _WIN32
@@ -36,71 +42,61 @@ using asio::ip::tcp;
 #include <gtest/gtest.h>
 #include <range/v3/all.hpp>
 
-template <typename T>
-constexpr auto stoi_base(string_view str)
-{
-    T result;
-    auto [p, ec] = std::from_chars(str.data(), str.data() + str.size(), result);
-    switch (ec) {
-    case std::errc::invalid_argument:
-        throw std::invalid_argument { "no conversion" };
-    case std::errc::result_out_of_range:
-        throw std::out_of_range { "out of range" };
-    default:
-        return result;
-    };
-}
-constexpr auto stoi = stoi_base<int>;
+#include <zlib.h>
+
+// stoi, and the engine for the tests of the endgame
+#include "../solver.hpp"
+// the room, driven without sockets on a virtual clock, and the server
+// embedded; with the search of bot.hpp, library.cpp includes them as well
+#include "../bot.hpp"
+#include "../server.hpp"
+// pack() against its definition
+#include "../packed.hpp"
 
 constexpr auto host = "127.0.0.1",
                port1 = "2333", port2 = "2334";
 
 struct ServerProcess {
+    // `args` are appended to the command line, e.g. "--http-port 2336"; a
+    // second server needs a `name` and `ports` of its own
+    ServerProcess(string_view args = "", string_view name = "nogo-server", string_view ports = "2333 2334")
+        : name(name)
+    {
 #ifdef _WIN32
-    constexpr static auto exec_cmd { "cmd /c start ./nogo-server 2333 2334" };
-    constexpr static auto kill_cmd { "taskkill /f /im nogo-server.exe" };
+        auto ret = system(fmt::format("cmd /c start ./nogo-server {} {}", ports, args).c_str());
 #else
-    constexpr static auto exec_cmd { "screen -dmS nogo-server ./nogo-server 2333 2334" };
-    constexpr static auto kill_cmd { "screen -S nogo-server -X stuff \"^C\"" };
+        auto ret = system(fmt::format("screen -dmS {} ./nogo-server {} {}", name, ports, args).c_str());
 #endif
-
-    ServerProcess()
-    {
-        auto ret = system(exec_cmd);
     }
     ~ServerProcess()
     {
-        auto ret = system(kill_cmd);
+#ifdef _WIN32
+        auto ret = system("taskkill /f /im nogo-server.exe");
+#else
+        auto ret = system(fmt::format("screen -S {} -X stuff \"^C\"", name).c_str());
+#endif
     }
+
+    string name;
 };
 
 asio::io_context io_context { 1 };
 
-class Session : public std::enable_shared_from_this<Session> {
+class Client : public std::enable_shared_from_this<Client> {
 public:
-    Session(tcp::socket socket)
+    Client(tcp::socket socket)
         : socket(std::move(socket))
     {
     }
 
-    ~Session()
+    ~Client()
     {
         socket.close();
     }
 
     auto do_read()
     {
-        io_context.restart();
-        asio::steady_timer timer { io_context, 1000ms };
-        timer.async_wait([&](auto ec) {
-            if (!ec)
-                throw std::runtime_error { fmt::format("timeout reading from {}", to_string()) };
-        });
-        asio::async_read_until(socket, buffer, '\n', [&](auto ec, auto) {
-            if (ec != asio::error::operation_aborted)
-                timer.cancel();
-        });
-        io_context.run();
+        with_timeout([&](auto handler) { asio::async_read_until(socket, buffer, '\n', handler); });
 
         std::istream stream(&buffer);
         std::string message;
@@ -108,6 +104,30 @@ public:
         return message;
     }
 
+    // everything up to and including `delim`, e.g. the head of an HTTP response
+    auto do_read_until(string_view delim)
+    {
+        with_timeout([&](auto handler) { asio::async_read_until(socket, buffer, string { delim }, handler); });
+
+        string data { asio::buffers_begin(buffer.data()), asio::buffers_end(buffer.data()) };
+        auto end { data.find(delim) };
+        auto message { end == string::npos ? data : data.substr(0, end + delim.size()) };
+        buffer.consume(message.size());
+        return message;
+    }
+
+    auto do_read_bytes(size_t count)
+    {
+        if (buffer.size() < count)
+            with_timeout([&](auto handler) { asio::async_read(socket, buffer, asio::transfer_exactly(count - buffer.size()), handler); });
+
+        // fewer if the connection was closed
+        count = std::min(count, buffer.size());
+        string message { asio::buffers_begin(buffer.data()), asio::buffers_begin(buffer.data()) + count };
+        buffer.consume(count);
+        return message;
+    }
+
     auto do_read(size_t count)
     {
         return ranges::views::iota(0uL, count)
@@ -120,11 +140,37 @@ public:
         asio::write(socket, asio::buffer(msg + '\n'));
     }
 
+    // bytes as they are, without the newline of a message
+    void do_write_raw(string_view data)
+    {
+        asio::write(socket, asio::buffer(data));
+    }
+
     auto to_string() const -> string
     {
         return socket.remote_endpoint().address().to_string() + ":" + std::to_string(socket.remote_endpoint().port());
     }
 
+    // runs one read, which throws after 1s without an answer; the read is
+    // cancelled first, it would otherwise complete into the next one
+    void with_timeout(auto&& read)
+    {
+        io_context.restart();
+        bool timed_out {};
+        asio::steady_timer timer { io_context, 1000ms };
+        timer.async_wait([&](auto ec) {
+            if (!ec) {
+                timed_out = true;
+                asio::error_code ignored;
+                socket.cancel(ignored);
+            }
+        });
+        read([&](auto ec, auto) { timer.cancel(); });
+        io_context.run();
+        if (timed_out)
+            throw std::runtime_error { fmt::format("timeout reading from {}", to_string()) };
+    }
+
     tcp::socket socket;
     asio::streambuf buffer;
     bool timeout { false };
@@ -134,7 +180,111 @@ auto launch_client(asio::io_context& io_context, string_view ip, string_view por
 {
     tcp::socket socket { io_context };
     socket.connect({ asio::ip::make_address(ip), static_cast<asio::ip::port_type>(stoi(port)) });
-    return std::make_shared<Session>(std::move(socket));
+    return std::make_shared<Client>(std::move(socket));
+}
+
+// GET `target` on a connection of its own, returns the head and the body
+auto http_get(string_view port, string_view target)
+{
+    auto c = launch_client(io_context, host, port);
+    c->do_write_raw(fmt::format("GET {} HTTP/1.1\r\nHost: {}\r\nConnection: close\r\n\r\n", target, host));
+    auto head = c->do_read_until("\r\n\r\n");
+    constexpr string_view content_length = "Content-Length: ";
+    auto pos = head.find(content_length);
+    auto length = pos == string::npos ? 0 : stoi(head.substr(pos + content_length.size(), head.find("\r\n", pos) - pos - content_length.size()));
+    return std::pair { head, c->do_read_bytes(length) };
+}
+
+namespace ws {
+
+// the key of the handshake in RFC 6455, and the answer it expects
+constexpr auto key = "dGhlIHNhbXBsZSBub25jZQ==", accept = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+
+// connect and send an upgrade request with `headers`, returns the head of the response
+auto handshake(string_view port, string_view headers)
+{
+    auto c = launch_client(io_context, host, port);
+    c->do_write_raw(fmt::format("GET / HTTP/1.1\r\nHost: {}\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: {}\r\n{}\r\n", host, key, headers));
+    auto head = c->do_read_until("\r\n\r\n");
+    return std::pair { c, head };
+}
+
+// a masked client frame
+auto frame(string_view payload, unsigned char opcode = 0x1)
+{
+    constexpr unsigned char mask[] { 0x12, 0x34, 0x56, 0x78 };
+    string res;
+    res += static_cast<char>(0x80 | opcode);
+    if (payload.size() < 126) {
+        res += static_cast<char>(0x80 | payload.size());
+    } else {
+        res += static_cast<char>(0x80 | 126);
+        res += static_cast<char>(payload.size() >> 8);
+        res += static_cast<char>(payload.size() & 0xff);
+    }
+    res.append(reinterpret_cast<const char*>(mask), 4);
+    for (size_t i = 0; i < payload.size(); i++)
+        res += static_cast<char>(payload[i] ^ mask[i % 4]);
+    return res;
+}
+
+struct Frame {
+    unsigned char opcode;
+    bool compressed;
+    string payload;
+};
+
+auto read(Client& session)
+{
+    auto head = session.do_read_bytes(2);
+    size_t length = head[1] & 0x7f;
+    if (length >= 126) {
+        auto bytes = session.do_read_bytes(length == 126 ? 2 : 8);
+        length = 0;
+        for (auto c : bytes)
+            length = length << 8 | static_cast<unsigned char>(c);
+    }
+    return Frame { static_cast<unsigned char>(head[0] & 0x0f), (head[0] & 0x40) != 0, session.do_read_bytes(length) };
+}
+
+// a message compressed without context takeover
+auto inflate(string data)
+{
+    data += string { "\x00\x00\xff\xff", 4 };
+    z_stream stream {};
+    inflateInit2(&stream, -15);
+    string res(1 << 16, '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(data.data());
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(res.data());
+    stream.avail_out = res.size();
+    ::inflate(&stream, Z_SYNC_FLUSH);
+    res.resize(res.size() - stream.avail_out);
+    inflateEnd(&stream);
+    return res;
+}
+
+// the next message with opcode `op`, skipping the others
+auto next(Client& session, int op)
+{
+    auto key = fmt::format(R"("op":{})", op);
+    for (;;) {
+        auto frame = read(session);
+        auto message = frame.compressed ? inflate(frame.payload) : frame.payload;
+        if (message.find(key) != string::npos)
+            return message;
+    }
+}
+
+}
+
+// the next line with opcode `op`, skipping the others
+auto next(Client& session, int op)
+{
+    auto key = fmt::format(R"("op":{})", op);
+    for (;;)
+        if (auto message = session.do_read(); message.find(key) != string::npos)
+            return message;
 }
 
 const vector<vector<string>> send_msgs1 {
@@ -276,8 +426,873 @@ TEST(nogo, server)
     }
     // TODO: Send LEAVE_OP
 }
+#ifndef _WIN32
+TEST(nogo, bot)
+{
+    constexpr int bot_move = 100018, move = 200002, leave = 200007;
+    constexpr auto http_port = "2336";
+    ServerProcess process { fmt::format("--bot-workers 1 --bot-worker-path ./nogo-bot-worker --http-port {}", http_port) };
+
+    std::this_thread::sleep_for(3s);
+
+    // an online game, in which Player1 lets the bot play its side
+    auto c1 = launch_client(io_context, host, port1);
+    auto c2 = launch_client(io_context, host, port2);
+    c1->do_write(R"({"op":100011,"data1":"Player1","data2":""})");
+    c2->do_write(R"({"op":200000,"data1":"Player2","data2":"w"})");
+    std::this_thread::sleep_for(100ms);
+    c1->do_write(R"({"op":100015,"data1":"","data2":""})");
+    std::this_thread::sleep_for(100ms);
+    c1->do_write(fmt::format(R"({{"op":{},"data1":"","data2":""}})", bot_move));
+
+    // the peer sees the bot's move like any other
+    std::this_thread::sleep_for(1500ms);
+    auto moved = next(*c2, move);
+    EXPECT_TRUE(moved.starts_with(R"({"data1":")")) << moved;
+#ifdef NOGO_MCTS_PROFILE
+    // the worker's profile comes back with the move
+    EXPECT_NE(http_get(http_port, "/metrics").second.find("mcts.nodes_per_second"), string::npos);
+#endif
+#ifdef NOGO_ALLOC_TRACKING
+    EXPECT_NE(http_get(http_port, "/metrics").second.find("alloc.mcts_search.bytes"), string::npos);
+#endif
+
+    // a remote player can't have our workers play for it
+    c2->do_write(fmt::format(R"({{"op":{},"data1":"","data2":""}})", bot_move));
+    EXPECT_EQ(next(*c1, leave), R"({"data1":"Player2","data2":"","op":200007})");
+}
+#endif
+
+TEST(nogo, websocket)
+{
+    constexpr auto websocket_port = "2335";
+    ServerProcess process { fmt::format("--websocket-port {}", websocket_port) };
+
+    std::this_thread::sleep_for(3s);
+
+    {
+        auto [c, head] = ws::handshake(websocket_port, "Sec-WebSocket-Version: 8\r\n");
+        EXPECT_TRUE(head.starts_with("HTTP/1.1 426")) << head;
+        EXPECT_NE(head.find("Sec-WebSocket-Version: 13"), string::npos) << head;
+    }
+    {
+        // zlib cannot deflate with a window of 8 bits, so the offer is declined
+        auto [c, head] = ws::handshake(websocket_port, "Sec-WebSocket-Version: 13\r\nSec-WebSocket-Extensions: permessage-deflate; server_max_window_bits=8\r\n");
+        EXPECT_TRUE(head.starts_with("HTTP/1.1 101")) << head;
+        EXPECT_NE(head.find(fmt::format("Sec-WebSocket-Accept: {}", ws::accept)), string::npos) << head;
+        EXPECT_EQ(head.find("Sec-WebSocket-Extensions"), string::npos) << head;
+    }
+
+    auto [c, head] = ws::handshake(websocket_port, "Sec-WebSocket-Version: 13\r\nSec-WebSocket-Extensions: permessage-deflate; server_no_context_takeover; server_max_window_bits=10\r\n");
+    EXPECT_NE(head.find("Sec-WebSocket-Extensions: permessage-deflate; server_no_context_takeover; server_max_window_bits=10"), string::npos) << head;
+
+    // the UI state is large enough to be compressed
+    c->do_write_raw(ws::frame(R"({"op":100000,"data1":"30","data2":"9"})"));
+    for (;;) {
+        auto frame = ws::read(*c);
+        auto message = frame.compressed ? ws::inflate(frame.payload) : frame.payload;
+        if (message.find(R"("op":100001)") != string::npos) {
+            EXPECT_TRUE(frame.compressed);
+            EXPECT_NE(message.find(R"(\"turn_timeout\":30)"), string::npos) << message;
+            break;
+        }
+    }
+
+    // a close frame is answered with one
+    c->do_write_raw(ws::frame("\x03\xe8", 0x8));
+    EXPECT_EQ(ws::read(*c).opcode, 0x8);
+}
+
+TEST(nogo, lobby)
+{
+    constexpr auto websocket_port = "2335";
+    constexpr int snapshot = 100021, update = 100022;
+    ServerProcess process { fmt::format("--websocket-port {}", websocket_port) };
+
+    std::this_thread::sleep_for(3s);
+
+    // a tab gets the lobby as it joins, and itself with the next tick
+    auto [c, head] = ws::handshake(websocket_port, "Sec-WebSocket-Version: 13\r\n");
+    EXPECT_EQ(ws::next(*c, snapshot), R"({"data1":"[]","data2":"","op":100021})");
+    auto added = ws::next(*c, update);
+    EXPECT_NE(added.find(R"([{\"event\":\"add\",\"id\":1,\"name\":\"127.0.0.1:)"), string::npos) << added;
+
+    auto c1 = launch_client(io_context, host, port1);
+    auto c2 = launch_client(io_context, host, port2);
+    std::this_thread::sleep_for(300ms);
+    added = ws::next(*c, update);
+    EXPECT_NE(added.find(R"({\"event\":\"add\",\"id\":2,)"), string::npos) << added;
+    EXPECT_NE(added.find(R"({\"event\":\"add\",\"id\":3,)"), string::npos) << added;
+
+    // players are known by their id, and a new name is an update
+    c1->do_write(R"({"op":100011,"data1":"Player1","data2":""})");
+    c2->do_write(R"({"op":200000,"data1":"Player2","data2":"w"})");
+    std::this_thread::sleep_for(300ms);
+    auto updated = ws::next(*c, update);
+    EXPECT_NE(updated.find(R"({\"event\":\"update\",\"id\":2,\"name\":\"Player1\",\"status\":0})"), string::npos) << updated;
+    EXPECT_NE(updated.find(R"({\"event\":\"update\",\"id\":3,\"name\":\"Player2\",\"status\":2})"), string::npos) << updated;
+    EXPECT_EQ(updated.find("remove"), string::npos) << updated;
+
+    // the line protocol asks for the lobby
+    c1->do_write(R"({"op":100019,"data1":"","data2":""})");
+    auto players = next(*c1, snapshot);
+    EXPECT_NE(players.find(R"({\"id\":2,\"name\":\"Player1\",\"status\":0})"), string::npos) << players;
+    EXPECT_NE(players.find(R"({\"id\":3,\"name\":\"Player2\",\"status\":2})"), string::npos) << players;
+
+    c2.reset();
+    std::this_thread::sleep_for(300ms);
+    EXPECT_EQ(next(*c1, update), R"({"data1":"[{\"event\":\"remove\",\"id\":3}]","data2":"","op":100022})");
+}
+
+TEST(nogo, chat)
+{
+    constexpr int capacity = 100, messages = capacity + 5;
+    std::remove("chat.jsonl");
+    ServerProcess process { "--chat-log chat.jsonl" };
+
+    std::this_thread::sleep_for(3s);
+
+    // chat to remote players before any of them is here
+    auto c1 = launch_client(io_context, host, port1);
+    c1->do_write(R"({"op":100011,"data1":"Player1","data2":""})");
+    for (int i = 0; i < messages; i++)
+        c1->do_write(fmt::format(R"({{"op":100008,"data1":"m{:03}","data2":""}})", i));
+    std::this_thread::sleep_for(100ms);
+
+    // who joins is caught up on the last of it, oldest first
+    auto c2 = launch_client(io_context, host, port2);
+    for (int i = messages - capacity; i < messages; i++)
+        ASSERT_EQ(c2->do_read(), fmt::format(R"({{"data1":"m{:03}","data2":"","op":200008}})", i));
+
+    // and the local side on what remote players said
+    c2->do_write(R"({"op":200008,"data1":"hi","data2":""})");
+    std::this_thread::sleep_for(100ms);
+    auto c3 = launch_client(io_context, host, port1);
+    auto caught_up = next(*c3, 100009);
+    EXPECT_TRUE(caught_up.starts_with(R"({"data1":"hi","data2":"127.0.0.1")")) << caught_up;
+
+    std::this_thread::sleep_for(100ms);
+    std::ifstream log { "chat.jsonl" };
+    vector<string> lines;
+    for (string line; std::getline(log, line);)
+        lines.push_back(line);
+    ASSERT_EQ(lines.size(), messages + 1);
+    EXPECT_NE(lines.front().find(R"("from":"Player1","message":{"data1":"m000")"), string::npos) << lines.front();
+    EXPECT_NE(lines.back().find(R"("from":"127.0.0.1","message":{"data1":"hi")"), string::npos) << lines.back();
+}
+
+TEST(nogo, topic)
+{
+    constexpr int topic_message = 100026, chat = 200008;
+    ServerProcess process {};
+
+    std::this_thread::sleep_for(3s);
+
+    auto c1 = launch_client(io_context, host, port1);
+    auto c2 = launch_client(io_context, host, port2);
+    c1->do_write(R"({"op":100011,"data1":"Player1","data2":""})");
+    c2->do_write(R"({"op":100023,"data1":"news","data2":""})");
+    std::this_thread::sleep_for(100ms);
+    c1->do_write(R"({"op":100025,"data1":"news","data2":"hello"})");
+    EXPECT_EQ(next(*c2, topic_message), R"({"data1":"news","data2":"{\"from\":\"Player1\",\"text\":\"hello\"}","op":100026})");
+
+    // nothing on the topic after leaving it
+    c2->do_write(R"({"op":100024,"data1":"news","data2":""})");
+    std::this_thread::sleep_for(100ms);
+    c1->do_write(R"({"op":100025,"data1":"news","data2":"again"})");
+    c1->do_write(R"({"op":100008,"data1":"marker","data2":""})");
+    for (string message; (message = c2->do_read()).find(fmt::format(R"("op":{})", chat)) == string::npos;)
+        EXPECT_EQ(message.find("again"), string::npos) << message;
+
+    // an inbox can't be left, and a peer that tries is dropped
+    c2->do_write(R"({"op":100024,"data1":"user/127.0.0.1","data2":""})");
+    EXPECT_EQ(c2->do_read(), "");
+
+    // nor can a peer open topics without end
+    auto c3 = launch_client(io_context, host, port2);
+    for (int i = 0; i < 1024; i++)
+        c3->do_write(fmt::format(R"({{"op":100023,"data1":"topic{}","data2":""}})", i));
+    EXPECT_NO_THROW({
+        while (!c3->do_read().empty()) { }
+    });
+}
+
+// The server as node "a" of a cluster, and node "b" a listener here that
+// reads nothing until "a" has queued far more frames for it than it keeps.
+// What it reads then must be whole frames, in order, up to the last one.
+TEST(nogo, cluster_overflow)
+{
+    constexpr auto link_port = 2340;
+    constexpr int messages = 30000, recipients = 16;
+    std::ofstream { "cluster.json" } << fmt::format(R"({{"secret":"s3cret","nodes":[)"
+                                                    R"({{"id":"a","host":"127.0.0.1","port":{},"peer_port":{},"link_port":2337}},)"
+                                                    R"({{"id":"b","host":"127.0.0.1","port":2338,"peer_port":2339,"link_port":{}}}]}})",
+        port1, port2, link_port);
+    tcp::acceptor acceptor { io_context };
+    acceptor.open(tcp::v4());
+    acceptor.set_option(tcp::acceptor::reuse_address { true });
+    acceptor.set_option(asio::socket_base::receive_buffer_size { 4096 });
+    acceptor.bind({ asio::ip::make_address(host), link_port });
+    acceptor.listen();
+    ServerProcess process { "--cluster cluster.json --node a" };
+
+    std::this_thread::sleep_for(3s);
+
+    Client link { acceptor.accept() };
+    auto c1 = launch_client(io_context, host, port1);
+    c1->do_write(R"({"op":100011,"data1":"Player1","data2":""})");
+    // chat for players on other nodes, about half of whom "b" knows of
+    string padding(900, '.');
+    for (int i = 0; i < messages; i++)
+        c1->do_write(fmt::format(R"({{"op":100007,"data1":"{:06}{}","data2":"x{}"}})", i, padding, i % recipients));
+    std::this_thread::sleep_for(3s);
+
+    constexpr unsigned char route = 3;
+    constexpr int max_queued_frames = 4096;
+    int last { -1 };
+    vector<bool> received(messages);
+    try {
+        for (;;) {
+            auto prefix = link.do_read_bytes(4);
+            ASSERT_EQ(prefix.size(), 4);
+            uint32_t size {};
+            for (int i = 3; i >= 0; i--)
+                size = size << 8 | static_cast<unsigned char>(prefix[i]);
+            ASSERT_LT(size, 1u << 16);
+            auto body = link.do_read_bytes(size);
+            ASSERT_EQ(body.size(), size);
+            if (static_cast<unsigned char>(body[0]) != route)
+                continue;
+            // from_user, from_node, to_user and to_node, the opcode, then data1
+            size_t pos = 1;
+            for (int field = 0; field < 4; field++)
+                pos += 2 + (static_cast<unsigned char>(body[pos]) | static_cast<unsigned char>(body[pos + 1]) << 8);
+            pos += 4 + 2;
+            ASSERT_LE(pos + 6 + padding.size(), body.size());
+            ASSERT_EQ(body.substr(pos + 6, padding.size()), padding);
+            auto index = stoi(string_view { body }.substr(pos, 6));
+            ASSERT_GT(index, last);
+            received[index] = true;
+            last = index;
+        }
+    } catch (const std::runtime_error&) {
+        // nothing more within the timeout
+    }
+    ASSERT_GE(last, messages - recipients);
+
+    // the oldest frames made way for the newer, and the newest of them all
+    // came through, one after the other
+    vector<bool> to_b(recipients);
+    for (int i = 0; i < messages; i++)
+        to_b[i % recipients] = to_b[i % recipients] || received[i];
+    int run {}, sent {};
+    for (int i = messages - 1; i >= 0 && (!to_b[i % recipients] || received[i]); i--)
+        run += to_b[i % recipients];
+    for (int i = 0; i < messages; i++)
+        sent += to_b[i % recipients];
+    EXPECT_LT(std::count(received.begin(), received.end(), true), sent);
+    EXPECT_GE(run, max_queued_frames);
+}
+
+// Two nodes of a cluster on this box, a player connected to each: a request
+// and private chat reach the other by name.
+TEST(nogo, cluster)
+{
+    constexpr auto b_port1 = "2338", b_port2 = "2339";
+    std::ofstream { "cluster.json" } << fmt::format(R"({{"secret":"s3cret","nodes":[)"
+                                                    R"({{"id":"a","host":"127.0.0.1","port":{},"peer_port":{},"link_port":2337}},)"
+                                                    R"({{"id":"b","host":"127.0.0.1","port":{},"peer_port":{},"link_port":2340}}]}})",
+        port1, port2, b_port1, b_port2);
+    ServerProcess a { "--cluster cluster.json --node a" };
+    ServerProcess b { "--cluster cluster.json --node b", "nogo-server-b", fmt::format("{} {}", b_port1, b_port2) };
+
+    std::this_thread::sleep_for(3s);
+
+    auto c1 = launch_client(io_context, host, port1);
+    auto c2 = launch_client(io_context, host, b_port1);
+    c1->do_write(R"({"op":100011,"data1":"Player1","data2":""})");
+    c2->do_write(R"({"op":100011,"data1":"Player3","data2":""})");
+    std::this_thread::sleep_for(500ms);
+
+    // private chat, to a name that is nowhere first
+    c1->do_write(R"({"op":100007,"data1":"anyone there?","data2":"Nobody"})");
+    c1->do_write(R"({"op":100007,"data1":"hello from a","data2":"Player3"})");
+    EXPECT_EQ(next(*c2, 100009), R"({"data1":"hello from a","data2":"Player1","op":100009})");
+
+    // chat forged as Player3 on the link port of "a": without a HELLO, and
+    // with one that has the wrong secret
+    auto put = [](string& out, uint32_t v, int bytes) {
+        for (int i = 0; i < bytes; i++)
+            out.push_back(static_cast<char>(v >> (8 * i)));
+    };
+    auto frame = [&](unsigned char type, vector<string> fields, std::optional<uint32_t> op = {}) {
+        string body(1, static_cast<char>(type)), res;
+        for (size_t i = 0; i < fields.size(); i++) {
+            // ROUTE has the opcode after from_user, from_node, to_user, to_node
+            if (op && i == 4)
+                put(body, *op, 4);
+            put(body, fields[i].size(), 2);
+            body += fields[i];
+        }
+        put(res, body.size(), 4);
+        return res + body;
+    };
+    auto forged = frame(3, { "Player3", "b", "Player1", "a", "forged", "" }, 200008);
+    auto stranger = launch_client(io_context, host, "2337");
+    asio::write(stranger->socket, asio::buffer(forged));
+    auto impostor = launch_client(io_context, host, "2337");
+    asio::write(impostor->socket, asio::buffer(frame(0, { "b", "guess" }) + forged));
+    std::this_thread::sleep_for(500ms);
+
+    c2->do_write(R"({"op":100007,"data1":"hello from b","data2":"Player1"})");
+    EXPECT_EQ(next(*c1, 100009), R"({"data1":"hello from b","data2":"Player3","op":100009})");
+
+    // a request, accepted on the other node
+    c1->do_write(R"({"op":100013,"data1":"Player3","data2":"b"})");
+    EXPECT_EQ(next(*c2, 100014), R"({"data1":"Player1","data2":"b","op":100014})");
+    c2->do_write(R"({"op":100015,"data1":"","data2":""})");
+    EXPECT_EQ(next(*c1, 100017), R"({"data1":"accepted","data2":"Player3","op":100017})");
+    c1->do_write(R"({"op":200002,"data1":"A1","data2":"1683446065123"})");
+    EXPECT_EQ(next(*c2, 200002), R"({"data1":"A1","data2":"1683446065123","op":200002})");
+}
+
+#ifndef _WIN32
+// A game moves from node "a" to node "b" of a cluster: both players are
+// redirected with a token, resume their seats there and play on.
+TEST(nogo, migration)
+{
+    constexpr auto b_port1 = "2338", b_port2 = "2339";
+    std::ofstream { "cluster.json" } << fmt::format(R"({{"secret":"s3cret","nodes":[)"
+                                                    R"({{"id":"a","host":"127.0.0.1","port":{},"peer_port":{},"link_port":2337}},)"
+                                                    R"({{"id":"b","host":"127.0.0.1","port":{},"peer_port":{},"link_port":2340}}]}})",
+        port1, port2, b_port1, b_port2);
+    ServerProcess a { "--cluster cluster.json --node a" };
+    ServerProcess b { "--cluster cluster.json --node b", "nogo-server-b", fmt::format("{} {}", b_port1, b_port2) };
+
+    std::this_thread::sleep_for(3s);
+
+    auto c1 = launch_client(io_context, host, port1);
+    auto c2 = launch_client(io_context, host, port2);
+    c1->do_write(R"({"op":100011,"data1":"Player1","data2":""})");
+    c2->do_write(R"({"op":200000,"data1":"Player2","data2":"w"})");
+    next(*c1, 100014);
+    c1->do_write(R"({"op":100015,"data1":"","data2":""})");
+    next(*c2, 200000);
+    c1->do_write(R"({"op":200002,"data1":"A1","data2":"1683446065123"})");
+    next(*c2, 200002);
+
+    // before a rolling restart of "a"
+    auto ret = system(fmt::format("pkill -USR2 -f '[n]ogo-server {} {}'", port1, port2).c_str());
+    std::chrono::steady_clock::time_point redirected_at;
+    auto redirected = [&](Client& c, string_view port) {
+        auto redirect = next(c, 100027);
+        redirected_at = std::chrono::steady_clock::now();
+        EXPECT_TRUE(redirect.starts_with(fmt::format(R"({{"data1":"127.0.0.1:{}","data2":")", port))) << redirect;
+        auto token = redirect.substr(redirect.find(R"("data2":")") + 9);
+        token = token.substr(0, token.find('"'));
+        auto resumed = launch_client(io_context, host, port);
+        resumed->do_write(fmt::format(R"({{"op":100028,"data1":"{}","data2":""}})", token));
+        return resumed;
+    };
+    auto r1 = redirected(*c1, b_port1);
+    // the pause a player sees: from the redirect to the state of the game on
+    // the new node
+    next(*r1, 100001);
+    auto pause = std::chrono::steady_clock::now() - redirected_at;
+    fmt::print("redirect pause: {}us\n", std::chrono::duration_cast<std::chrono::microseconds>(pause).count());
+    EXPECT_LT(pause, 100ms);
+    auto r2 = redirected(*c2, b_port2);
+
+    // the game goes on where it was
+    r2->do_write(R"({"op":200002,"data1":"A2","data2":"1683446066123"})");
+    EXPECT_EQ(next(*r1, 200002), R"({"data1":"A2","data2":"1683446066123","op":200002})");
+    auto state = next(*r1, 100001);
+    EXPECT_NE(state.find(R"(\"move_count\":2)"), string::npos) << state;
+
+    // a token that was never handed out drops the peer
+    auto c3 = launch_client(io_context, host, b_port2);
+    c3->do_write(R"({"op":100028,"data1":"bogus","data2":""})");
+    EXPECT_EQ(c3->do_read(), "");
+}
+
+// The peer of the game is a server of its own, node "c": it follows the
+// room to node "b" by itself and its player plays on.
+TEST(nogo, migration_peer)
+{
+    constexpr auto b_port1 = "2338", b_port2 = "2339", c_port1 = "2341", c_port2 = "2342";
+    std::ofstream { "cluster.json" } << fmt::format(R"({{"secret":"s3cret","nodes":[)"
+                                                    R"({{"id":"a","host":"127.0.0.1","port":{},"peer_port":{},"link_port":2337}},)"
+                                                    R"({{"id":"b","host":"127.0.0.1","port":{},"peer_port":{},"link_port":2340}},)"
+                                                    R"({{"id":"c","host":"127.0.0.1","port":{},"peer_port":{},"link_port":2343}}]}})",
+        port1, port2, b_port1, b_port2, c_port1, c_port2);
+    ServerProcess a { "--cluster cluster.json --node a" };
+    ServerProcess b { "--cluster cluster.json --node b", "nogo-server-b", fmt::format("{} {}", b_port1, b_port2) };
+    ServerProcess c { "--cluster cluster.json --node c", "nogo-server-c", fmt::format("{} {}", c_port1, c_port2) };
+
+    std::this_thread::sleep_for(3s);
+
+    auto c1 = launch_client(io_context, host, port1);
+    auto c2 = launch_client(io_context, host, c_port1);
+    c1->do_write(R"({"op":100011,"data1":"Player1","data2":""})");
+    c2->do_write(R"({"op":100011,"data1":"Player2","data2":""})");
+    c2->do_write(fmt::format(R"({{"op":100004,"data1":"{}","data2":"{}"}})", host, port2));
+    EXPECT_EQ(next(*c2, 100005), fmt::format(R"({{"data1":"success","data2":"{}:{}","op":100005}})", host, port2));
+    std::this_thread::sleep_for(100ms);
+    c2->do_write(fmt::format(R"({{"op":100012,"data1":"{}:{}","data2":"w"}})", host, port2));
+    next(*c1, 100014);
+    c1->do_write(R"({"op":100015,"data1":"","data2":""})");
+    next(*c2, 100017);
+    c1->do_write(R"({"op":200002,"data1":"A1","data2":"1683446065123"})");
+    next(*c2, 200002);
+
+    auto ret = system(fmt::format("pkill -USR2 -f '[n]ogo-server {} {}'", port1, port2).c_str());
+    auto redirect = next(*c1, 100027);
+    auto token = redirect.substr(redirect.find(R"("data2":")") + 9);
+    token = token.substr(0, token.find('"'));
+    auto r1 = launch_client(io_context, host, b_port1);
+    r1->do_write(fmt::format(R"({{"op":100028,"data1":"{}","data2":""}})", token));
+
+    // "c" connected to "b" and the move comes from there
+    c2->do_write(R"({"op":200002,"data1":"A2","data2":"1683446066123"})");
+    EXPECT_EQ(next(*r1, 200002), R"({"data1":"A2","data2":"1683446066123","op":200002})");
+    r1->do_write(R"({"op":200002,"data1":"B2","data2":"1683446067123"})");
+    EXPECT_EQ(next(*c2, 200002), R"({"data1":"B2","data2":"1683446067123","op":200002})");
+}
+#endif
+
+#ifndef _WIN32
+// A new process takes the server over, with the live connections and a
+// pending request. The first try is called off, while a peer that doesn't
+// read still has chat to be written to it, and the second one dies halfway.
+TEST(nogo, upgrade)
+{
+    constexpr auto http_port = "2336";
+    constexpr int messages = 3000;
+    ServerProcess old_process { fmt::format("--upgrade-socket upgrade.sock --http-port {}", http_port) };
+
+    std::this_thread::sleep_for(3s);
+
+    auto c1 = launch_client(io_context, host, port1);
+    // reads slowly, with a small buffer
+    tcp::socket socket { io_context };
+    socket.open(tcp::v4());
+    socket.set_option(asio::socket_base::receive_buffer_size { 4096 });
+    socket.connect({ asio::ip::make_address(host), static_cast<asio::ip::port_type>(stoi(port2)) });
+    auto c2 = std::make_shared<Client>(std::move(socket));
+    c1->do_write(R"({"op":100011,"data1":"Player1","data2":""})");
+    c2->do_write(R"({"op":200000,"data1":"Player2","data2":"w"})");
+    next(*c1, 100014);
+    string padding(900, '.');
+    for (int i = 0; i < messages; i++)
+        c1->do_write(fmt::format(R"({{"op":100008,"data1":"{:06}{}","data2":""}})", i, padding));
+    std::this_thread::sleep_for(1s);
+
+    {
+        ServerProcess called_off { "--takeover upgrade.sock" };
+        std::this_thread::sleep_for(2s);
+    }
+    EXPECT_NE(http_get(http_port, "/rooms").second.find(R"("participants":2)"), string::npos);
+    // the chat still comes through, all of it
+    for (int i = 0; i < messages; i++)
+        ASSERT_EQ(next(*c2, 200008), fmt::format(R"({{"data1":"{:06}{}","data2":"","op":200008}})", i, padding));
+
+    // a new process that dies after the first frame of the handover: the
+    // old one still accepts, and serves everyone
+    {
+        asio::local::stream_protocol::socket taker { io_context };
+        taker.connect({ "upgrade.sock" });
+        char prefix[4];
+        asio::read(taker, asio::buffer(prefix));
+    }
+    std::this_thread::sleep_for(1s);
+    auto c3 = launch_client(io_context, host, port2);
+    std::this_thread::sleep_for(500ms);
+    auto rooms = http_get(http_port, "/rooms").second;
+    EXPECT_NE(rooms.find(R"("participants":3)"), string::npos) << rooms;
+    c1->do_write(R"({"op":100008,"data1":"still here","data2":""})");
+    EXPECT_EQ(next(*c2, 200008), R"({"data1":"still here","data2":"","op":200008})");
+    // after the chat history
+    string chat;
+    while (chat.find("still here") == string::npos)
+        chat = next(*c3, 200008);
+    EXPECT_EQ(chat, R"({"data1":"still here","data2":"","op":200008})");
+
+    ServerProcess new_process { fmt::format("--takeover upgrade.sock --http-port {} --chat-log upgraded.jsonl", http_port) };
+    std::this_thread::sleep_for(3s);
+    // the request made to the old process is accepted by the new one
+    c1->do_write(R"({"op":100015,"data1":"","data2":""})");
+    EXPECT_EQ(next(*c2, 200000), R"({"data1":"Player1","data2":"b","op":200000})");
+    c1->do_write(R"({"op":100008,"data1":"upgraded","data2":""})");
+    EXPECT_EQ(next(*c2, 200008), R"({"data1":"upgraded","data2":"","op":200008})");
+    std::stringstream log;
+    log << std::ifstream { "upgraded.jsonl" }.rdbuf();
+    EXPECT_NE(log.str().find("upgraded"), string::npos) << log.str();
+    std::remove("upgraded.jsonl");
+}
+#endif
+
+TEST(nogo, http)
+{
+    constexpr auto http_port = "2336", websocket_port = "2335";
+    ServerProcess process { fmt::format("--http-port {} --websocket-port {}", http_port, websocket_port) };
+
+    std::this_thread::sleep_for(3s);
+
+    auto get = [&](string_view target) { return http_get(http_port, target); };
+    auto [head, body] = get("/rooms");
+    EXPECT_TRUE(head.starts_with("HTTP/1.1 200")) << head;
+    EXPECT_EQ(body, R"([{"move_count":0,"participants":0,"players":[],"status":0}])");
+    EXPECT_TRUE(get("/nothing").first.starts_with("HTTP/1.1 404"));
+
+    // a browser tab is in the room once upgraded, and until it is closed
+    {
+        auto participants = [&] { return get("/rooms").second; };
+        auto [declined, declined_head] = ws::handshake(websocket_port, "Sec-WebSocket-Version: 8\r\n");
+        EXPECT_TRUE(declined_head.starts_with("HTTP/1.1 426")) << declined_head;
+        std::this_thread::sleep_for(100ms);
+        EXPECT_NE(participants().find(R"("participants":0)"), string::npos) << participants();
+
+        auto [c, head] = ws::handshake(websocket_port, "Sec-WebSocket-Version: 13\r\n");
+        EXPECT_NE(participants().find(R"("participants":1)"), string::npos) << participants();
+        c->do_write_raw(ws::frame("\x03\xe8", 0x8));
+        while (ws::read(*c).opcode != 0x8) { }
+        std::this_thread::sleep_for(100ms);
+        EXPECT_NE(participants().find(R"("participants":0)"), string::npos) << participants();
+    }
+
+    // an online game, which Player1 wins, then a local one, which is not a result
+    auto c1 = launch_client(io_context, host, port1);
+    auto c2 = launch_client(io_context, host, port2);
+    auto send = [](auto& c, string msg) {
+        c->do_write(msg);
+        std::this_thread::sleep_for(50ms);
+    };
+    send(c1, R"({"op":100011,"data1":"Player1","data2":""})");
+    send(c2, R"({"op":200000,"data1":"Player2","data2":"w"})");
+    send(c1, R"({"op":100015,"data1":"","data2":""})");
+    for (auto [c, move] : { std::pair { c1, "A1" }, { c2, "A2" }, { c1, "B2" }, { c2, "B1" } })
+        send(c, fmt::format(R"({{"op":200002,"data1":"{}","data2":"1683446065123"}})", move));
+    send(c2, R"({"op":200005,"data1":"","data2":""})");
+    send(c1, R"({"op":100000,"data1":"30","data2":"9"})");
+    for (auto [move, role] : { std::pair { "A1", "b" }, { "A2", "w" }, { "B2", "b" }, { "B1", "w" } })
+        send(c1, fmt::format(R"({{"op":100003,"data1":"{}","data2":"{}"}})", move, role));
+
+    EXPECT_NE(get("/rooms").second.find(R"("participants":2)"), string::npos);
+    auto games = get("/games").second;
+    EXPECT_TRUE(games.starts_with(R"([{"black":"Player1")")) << games;
+    EXPECT_EQ(games.find("},{"), string::npos) << games;
+    EXPECT_EQ(games.find("BLACK"), string::npos) << games;
+    EXPECT_NE(get("/games/1").second.find(R"("white":"Player2")"), string::npos);
+    EXPECT_TRUE(get("/games/2").first.starts_with("HTTP/1.1 404"));
+
+    auto leaderboard = get("/leaderboard").second;
+    EXPECT_EQ(leaderboard, R"([{"losses":0,"name":"Player1","wins":1},{"losses":1,"name":"Player2","wins":0}])");
+    // only `page` turns the page
+    EXPECT_EQ(get("/leaderboard?perpage=3").second, leaderboard);
+    EXPECT_EQ(get("/leaderboard?page=1").second, "[]");
+}
+
+// a player of the room that keeps what it is delivered
+class Recorder : public Participant {
+public:
+    Recorder(bool is_local, string name)
+        : Participant(is_local)
+        , name { std::move(name) }
+    {
+    }
+
+    string_view get_name() const override { return name; }
+    void set_name(string_view name) override { this->name = name; }
+    tcp::endpoint endpoint() const override { return {}; }
+    void deliver(Message msg) override { delivered.push_back(msg.op); }
+    void stop() override { }
+    bool operator==(const Participant& participant) const override { return this == &participant; }
+
+    auto count(OpCode op) const { return std::ranges::count(delivered, op); }
+
+    string name;
+    vector<OpCode> delivered;
+};
+
+// An online game on a virtual clock: each move gives the other side TIMEOUT
+// again, and the side to move loses on the nanosecond it runs out.
+TEST(room, timeout)
+{
+    asio::io_context context;
+    timing::VirtualClock clock { context };
+    Room room { context, &clock };
+    auto alice = std::make_shared<Recorder>(true, "alice");
+    auto bob = std::make_shared<Recorder>(false, "bob");
+    room.join(alice), room.join(bob);
+    auto send = [&](const std::shared_ptr<Recorder>& from, Message msg) {
+        room.process_data(std::move(msg), from);
+        if (context.stopped())
+            context.restart();
+        context.poll();
+    };
+
+    send(bob, { OpCode::READY_OP, "bob", "b" });
+    send(alice, { OpCode::ACCEPT_REQUEST_OP });
+    send(bob, { OpCode::MOVE_OP, Point { 0 }.to_string(), "1000" });
+    clock.advance(20s);
+    send(alice, { OpCode::MOVE_OP, Point { 1 }.to_string(), "1000" });
+
+    // 50s into the game, but bob has had 30s only now
+    clock.advance(TIMEOUT - 1ns);
+    EXPECT_EQ(bob->count(OpCode::TIMEOUT_END_OP), 0);
+    EXPECT_EQ(alice->count(OpCode::WIN_PENDING_OP), 0);
+    clock.advance(1ns);
+    EXPECT_EQ(bob->count(OpCode::TIMEOUT_END_OP), 1);
+    EXPECT_EQ(alice->count(OpCode::WIN_PENDING_OP), 1);
+    EXPECT_EQ(clock.pending(), 0);
+
+    // bob confirms, and nothing is left to run out
+    send(bob, { OpCode::TIMEOUT_END_OP });
+    clock.advance(TIMEOUT);
+    EXPECT_EQ(bob->count(OpCode::TIMEOUT_END_OP), 1);
+}
+
+// The server embedded: started on a thread of its own and stopped, with
+// connections within the process in place of sockets.
+TEST(server, embedded)
+{
+    auto begin = std::chrono::steady_clock::now();
+    {
+        Server server;
+        server.start();
+        server.stop();
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - begin, 1s);
+
+    Server server;
+    server.start();
+    // a chat round trip
+    auto frontend = server.connect(true), remote = server.connect(false);
+    remote->send({ OpCode::CHAT_OP, "ping" });
+    std::optional<Message> chat;
+    while ((chat = frontend->receive(1s)) && chat->op != OpCode::CHAT_RECEIVE_MESSAGE_OP) { }
+    ASSERT_TRUE(chat);
+    EXPECT_EQ(chat->data1, "ping");
+
+    // a handler has everything from the first message on: the chat it
+    // catches up on as it joins
+    std::promise<Message> first;
+    std::atomic<int> delivered;
+    auto handled = server.connect(true, [&](Message msg) {
+        if (delivered++ == 0)
+            first.set_value(msg);
+    });
+    auto first_message = first.get_future();
+    ASSERT_EQ(first_message.wait_for(1s), std::future_status::ready);
+    EXPECT_EQ(first_message.get().data1, "ping");
+    EXPECT_FALSE(handled->receive(10ms));
+
+    // nothing more, after the timeout
+    while (frontend->receive(100ms)) { }
+    begin = std::chrono::steady_clock::now();
+    EXPECT_FALSE(frontend->receive(50ms));
+    EXPECT_GE(std::chrono::steady_clock::now() - begin, 50ms);
+
+    // a remote connection closes once told to leave, or to go elsewhere
+    auto closes = [](auto& session) {
+        for (int i = 0; i < 100 && !session->closed(); i++)
+            std::this_thread::sleep_for(10ms);
+        return session->closed();
+    };
+    remote->send({ OpCode::LEAVE_OP });
+    EXPECT_TRUE(closes(remote));
+    auto redirected = server.connect(false);
+    asio::post(server.io_context(), [&] { redirected->deliver({ OpCode::REDIRECT_OP, "127.0.0.1:2334", "token" }); });
+    auto redirect = redirected->receive(1s);
+    ASSERT_TRUE(redirect);
+    EXPECT_EQ(redirect->op, OpCode::REDIRECT_OP);
+    EXPECT_TRUE(closes(redirected));
+    EXPECT_FALSE(frontend->closed());
+
+    server.stop();
+}
+
+// Random endgames of the 9x9 board, played out from the empty one until at
+// most `empty` points are left; none if the game ends first.
+auto random_endgame(std::mt19937& rng, int empty) -> std::optional<State>
+{
+    State state;
+    while (state.board.empty().count() > empty) {
+        auto moves = state.board.legal(state.role);
+        if (!moves)
+            return std::nullopt;
+        for (auto skip = rng() % moves.count(); skip; skip--)
+            moves.reset(moves.first());
+        state = state.next_state(moves.first());
+    }
+    return state;
+}
+
+// cgt.hpp against exhaustive search: the winner of every position it values,
+// and a winning move among those it doesn't order last.
+TEST(cgt, exhaustive)
+{
+    std::map<std::array<std::uint64_t, 5>, bool> memo;
+    // whether the side to move wins, from every move
+    auto wins = [&](auto& self, const Board& board, Role role) -> bool {
+        auto black = board.stones(Role::BLACK), white = board.stones(Role::WHITE);
+        std::array key { black.lo, black.hi, white.lo, white.hi, std::uint64_t(role == Role::BLACK) };
+        if (auto it = memo.find(key); it != memo.end())
+            return it->second;
+        auto res = false;
+        for (auto moves = board.legal(role); moves && !res; moves.reset(moves.first()))
+            res = !self(self, *board.play(moves.first(), role), -role);
+        return memo[key] = res;
+    };
+
+    std::mt19937 rng { 95 };
+    cgt::Evaluator<> evaluator;
+    int valued {};
+    for (int i = 0; i < 2000; i++) {
+        auto state = random_endgame(rng, 8 + i % 7);
+        if (!state)
+            continue;
+        auto& board = state->board;
+        auto role = state->role;
+        auto winner = evaluator.winner(board, role);
+        if (!winner)
+            continue;
+        valued++;
+        auto expected = wins(wins, board, role);
+        ASSERT_EQ(*winner, expected ? role : -role) << board;
+
+        auto moves = state->available_actions();
+        auto count = evaluator.order(board, role, moves);
+        ASSERT_LE(count, moves.size());
+        auto winning = [&](Point move) { return !wins(wins, *board.play(move, role), -role); };
+        EXPECT_EQ(std::any_of(moves.begin(), moves.begin() + count, winning), expected) << board;
+    }
+    fmt::print("{} endgames valued\n", valued);
+    EXPECT_GT(valued, 100);
+}
+
+// pack() agrees with its definition, 2 bits per point, row-major, with the
+// side to move after the last point, with and without SSE2, and unpack()
+// undoes it
+TEST(packed, round_trip)
+{
+    std::mt19937 rng { 92 };
+    constexpr std::array roles { Role::NONE, Role::BLACK, Role::WHITE };
+    for (int i = 0; i < 10000; i++) {
+        Board board {};
+        for (auto& cell : board.cells())
+            cell = roles[rng() % 3];
+        auto to_move = rng() % 2 ? Role::BLACK : Role::WHITE;
+        packed::PackedState expected;
+        for (std::size_t j = 0; j < packed::points; j++)
+            expected.bytes[j / 4] |= (board.cells()[j].id & 3) << (j % 4 * 2);
+        expected.bytes[packed::side_byte] |= (to_move.id & 3) << packed::side_shift;
+
+        ASSERT_EQ(packed::pack_scalar(board, to_move), expected);
+        ASSERT_EQ(packed::pack(board, to_move), expected);
+        auto [unpacked, unpacked_to_move] = packed::unpack(expected);
+        ASSERT_EQ(unpacked, board);
+        ASSERT_EQ(unpacked_to_move, to_move);
+    }
+#ifndef NOGO_PACKED_SSE2
+    fmt::print("no SSE2, pack() is pack_scalar()\n");
+#endif
+}
+
+// The solver reaches the same results with cgt.hpp in the endgame as without,
+// on random 5x5 positions with 12 empty points.
+TEST(solver, endgame)
+{
+    using Position = solver::Position<5>;
+    std::mt19937 rng { 96 };
+    for (int solved = 0; solved < 30;) {
+        Position position;
+        while (Position::points - std::popcount(position.own | position.opp) > 12 && position.moves()) {
+            auto moves = position.moves();
+            for (auto skip = rng() % std::popcount(moves); skip; skip--)
+                moves &= moves - 1;
+            position = position.play(std::countr_zero(moves));
+        }
+        if (!position.moves())
+            continue;
+        solved++;
+        solver::Solver<5> plain { 1 }, endgame { 1, Position::points };
+        auto wins = plain.solve(position);
+        ASSERT_EQ(endgame.solve(position), wins);
+        auto move = endgame.winning_move(position);
+        ASSERT_EQ(move.has_value(), wins);
+        if (move)
+            EXPECT_FALSE(plain.solve(position.play(*move)));
+    }
+}
+
+// Whether the side to move wins, by trying every line, with the positions
+// already seen remembered as they are, without symmetries
+template <int N>
+bool brute_force(const solver::Position<N>& position, std::unordered_map<std::uint64_t, bool>& seen)
+{
+    auto key { position.own << 32 | position.opp };
+    if (auto it = seen.find(key); it != seen.end())
+        return it->second;
+    bool wins {};
+    for (auto rest { position.moves() }; rest && !wins; rest &= rest - 1)
+        wins = !brute_force(position.play(std::countr_zero(rest)), seen);
+    return seen[key] = wins;
+}
+
+// Plays the table's side with `bot` against every reply of the other side,
+// checking that the other side runs out of moves and that `loaded` answers
+// like `table` along the way. Returns the number of lines.
+template <int N>
+auto play_every_line(solver::TableBot<N>& bot, const solver::Table<N>& table, const solver::Table<N>& loaded, const solver::Position<N>& position, bool bot_to_move) -> std::size_t
+{
+    EXPECT_EQ(loaded.move(position), table.move(position));
+    if (!position.moves()) {
+        EXPECT_FALSE(bot_to_move) << "the table's side ran out of moves";
+        return 1;
+    }
+    if (bot_to_move) {
+        auto move = bot.play(position);
+        EXPECT_TRUE(move && position.legal(*move));
+        return play_every_line(bot, table, loaded, position.play(*move), false);
+    }
+    std::size_t lines {};
+    for (auto rest { position.moves() }; rest; rest &= rest - 1)
+        lines += play_every_line(bot, table, loaded, position.play(std::countr_zero(rest)), true);
+    return lines;
+}
+
+// 2x2 and 3x3 are first-player wins and 4x4 a second-player win, as a search
+// of every line finds. 5x5 is out of reach, see solver.hpp.
+TEST(solver, small_boards)
+{
+    std::unordered_map<std::uint64_t, bool> seen2, seen3, seen4;
+    EXPECT_TRUE(brute_force(solver::Position<2> {}, seen2));
+    EXPECT_TRUE(brute_force(solver::Position<3> {}, seen3));
+    EXPECT_FALSE(brute_force(solver::Position<4> {}, seen4));
+    EXPECT_TRUE(solver::Solver<2> { 1 }.solve({}));
+    EXPECT_TRUE(solver::Solver<3> { 1 }.solve({}));
+    EXPECT_FALSE(solver::Solver<4> { 2 }.solve({}));
+
+    // the 3x3 table survives a round trip through a file, and the bot playing
+    // black from it wins every line
+    solver::Solver<3> solver { 1 };
+    auto table = solver.table({});
+    table.save("solver-3x3.tbl");
+    auto loaded = solver::Table<3>::load("solver-3x3.tbl");
+    std::remove("solver-3x3.tbl");
+    EXPECT_EQ(loaded.size(), table.size());
+    solver::TableBot<3> bot { loaded };
+    auto lines = play_every_line(bot, table, loaded, {}, true);
+    fmt::print("{} lines of 3x3 won\n", lines);
+    EXPECT_GT(lines, 1);
+}
+
 int main(int argc, char* argv[])
 {
+    // for the room and the server run within the tests
+    logger = spdlog::logger("test");
+    logger->set_level(spdlog::level::off);
     testing::InitGoogleTest();
     return RUN_ALL_TESTS();
 }
\ No newline at end of file
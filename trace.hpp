@@ -0,0 +1,182 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Span tracer. Every thread records complete events into its own ring buffer
+// with no locking; `trace::dump` writes whatever the rings hold as Chrome /
+// Perfetto trace JSON. Recording is off until `trace::enabled` is set, and
+// defining NOGO_DISABLE_TRACE compiles TRACE_SCOPE away entirely.
+namespace trace {
+
+struct Event {
+    const char* name;
+    std::int64_t start, duration;
+    std::int64_t arg;
+    int tid;
+};
+
+// One event behind a seqlock: the writer makes `seq` odd while it stores the
+// fields, and a reader keeps its copy only if `seq` was even and unchanged.
+// The fields are relaxed atomics, so that a copy being overwritten is torn
+// without a data race, and then dropped.
+struct Slot {
+    std::atomic<std::uint64_t> seq {};
+    std::atomic<const char*> name {};
+    std::atomic<std::int64_t> start {}, duration {}, arg {};
+    std::atomic<int> tid {};
+
+    void store(const Event& event)
+    {
+        auto s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        name.store(event.name, std::memory_order_relaxed);
+        start.store(event.start, std::memory_order_relaxed);
+        duration.store(event.duration, std::memory_order_relaxed);
+        arg.store(event.arg, std::memory_order_relaxed);
+        tid.store(event.tid, std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    bool load(Event& event) const
+    {
+        auto s = seq.load(std::memory_order_acquire);
+        if (s & 1)
+            return false;
+        event = { name.load(std::memory_order_relaxed), start.load(std::memory_order_relaxed), duration.load(std::memory_order_relaxed),
+            arg.load(std::memory_order_relaxed), tid.load(std::memory_order_relaxed) };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return seq.load(std::memory_order_relaxed) == s;
+    }
+};
+
+struct Buffer {
+    enum { capacity = 1 << 14 };
+    std::array<Slot, capacity> slots;
+    std::atomic<std::uint64_t> head {};
+
+    void push(const Event& event)
+    {
+        auto h = head.load(std::memory_order_relaxed);
+        slots[h % capacity].store(event);
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+_EXPORT inline std::atomic<bool> enabled {};
+
+inline std::mutex registry_mutex;
+inline std::vector<std::shared_ptr<Buffer>> registry;
+// buffers of exited threads, reused so short-lived search threads don't pile up
+inline std::vector<std::shared_ptr<Buffer>> free_buffers;
+inline int next_tid { 1 };
+
+inline auto now() -> std::int64_t
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct ThreadBuffer {
+    Buffer* buffer;
+    int tid;
+};
+
+inline auto local_buffer() -> ThreadBuffer
+{
+    thread_local struct Holder {
+        std::shared_ptr<Buffer> buffer;
+        int tid;
+        Holder()
+        {
+            std::lock_guard lock { registry_mutex };
+            tid = next_tid++;
+            if (free_buffers.empty()) {
+                buffer = std::make_shared<Buffer>();
+                registry.push_back(buffer);
+            } else {
+                buffer = free_buffers.back();
+                free_buffers.pop_back();
+            }
+        }
+        ~Holder()
+        {
+            std::lock_guard lock { registry_mutex };
+            free_buffers.push_back(buffer);
+        }
+    } holder;
+    return { holder.buffer.get(), holder.tid };
+}
+
+_EXPORT class Scope {
+public:
+    explicit Scope(const char* name, std::int64_t arg = -1)
+        : name_ { enabled.load(std::memory_order_relaxed) ? name : nullptr }
+        , arg_ { arg }
+        , start_ { name_ ? now() : 0 }
+    {
+    }
+    Scope(const Scope&) = delete;
+    ~Scope()
+    {
+        if (name_) {
+            auto [buffer, tid] = local_buffer();
+            buffer->push({ name_, start_, now() - start_, arg_, tid });
+        }
+    }
+
+private:
+    const char* name_;
+    std::int64_t arg_;
+    std::int64_t start_;
+};
+
+// The recording threads carry on during a dump; an event that is being
+// overwritten as it is read is left out.
+_EXPORT inline bool dump(const std::string& path)
+{
+    std::ofstream out { path };
+    if (!out)
+        return false;
+    out << std::fixed << std::setprecision(3) << R"({"displayTimeUnit":"ns","traceEvents":[)";
+    bool first = true;
+    std::lock_guard lock { registry_mutex };
+    for (auto& buffer : registry) {
+        auto head = buffer->head.load(std::memory_order_acquire);
+        auto begin = head > Buffer::capacity ? head - Buffer::capacity : 0;
+        for (auto i = begin; i < head; i++) {
+            Event event;
+            if (!buffer->slots[i % Buffer::capacity].load(event))
+                continue;
+            out << (first ? "" : ",") << R"({"name":")" << event.name << R"(","ph":"X","pid":1,"tid":)" << event.tid
+                << R"(,"ts":)" << event.start / 1000.0 << R"(,"dur":)" << event.duration / 1000.0;
+            if (event.arg >= 0)
+                out << R"(,"args":{"op":)" << event.arg << "}";
+            out << "}";
+            first = false;
+        }
+    }
+    out << "]}";
+    return true;
+}
+
+}
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#ifdef NOGO_DISABLE_TRACE
+#define TRACE_SCOPE(...)
+#else
+#define TRACE_SCOPE(...) trace::Scope TRACE_CONCAT(trace_scope_, __LINE__) { __VA_ARGS__ }
+#endif
@@ -13,9 +13,11 @@
 #include <string_view>
 #include <vector>
 
+#include "alloc.hpp"
 #include "contest.hpp"
 #include "message.hpp"
 #include "rule.hpp"
+#include "trace.hpp"
 
 #ifdef __GNUC__
 #include <range/v3/all.hpp>
@@ -95,8 +97,8 @@ _EXPORT struct UiMessage : public Message {
         int move_count;
         long long start_time;
         long long end_time;
-        std::optional<Position> last_move;
-        std::vector<Position> disabled_positions;
+        std::optional<Point> last_move;
+        std::vector<Point> disabled_positions;
         GameMetadata metadata;
         std::vector<DynamicStatistics> statistics;
         Game() = default;
@@ -104,7 +106,7 @@ _EXPORT struct UiMessage : public Message {
             : now_playing(contest.current.role.id)
             , move_count(contest.round())
             , metadata(GameMetadata(contest))
-            , last_move(contest.moves.empty() ? std::nullopt : std::optional<Position>(contest.moves.back()))
+            , last_move(contest.moves.empty() ? std::nullopt : std::optional<Point>(contest.moves.back()))
             , start_time { std::chrono::duration_cast<std::chrono::milliseconds>(contest.start_time.time_since_epoch()).count() }
             , end_time { contest.status == Contest::Status::GAME_OVER ? std::chrono::duration_cast<std::chrono::milliseconds>(contest.end_time.time_since_epoch()).count() : 0 }
         {
@@ -140,7 +142,15 @@ _EXPORT struct UiMessage : public Message {
         NLOHMANN_DEFINE_TYPE_INTRUSIVE(UiState, is_gaming, status, game, game_result)
     };
     UiMessage(const Contest& contest)
-        : Message(OpCode::UPDATE_UI_STATE_OP, std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()), UiState(contest).to_string())
+        : Message(OpCode::UPDATE_UI_STATE_OP, std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()), serialize(contest))
     {
     }
+
+private:
+    static auto serialize(const Contest& contest) -> string
+    {
+        TRACE_SCOPE("UiMessage::serialize");
+        ALLOC_SCOPE("UiMessage::serialize");
+        return UiState(contest).to_string();
+    }
 };
\ No newline at end of file
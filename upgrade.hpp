@@ -0,0 +1,291 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <asio/dispatch.hpp>
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <asio/socket_base.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "log.hpp"
+
+using asio::ip::tcp;
+using nlohmann::json;
+
+// Binary upgrades without downtime. The running server listens on a unix
+// domain socket; a new process started with --takeover connects to it and
+// receives, as file descriptors passed with SCM_RIGHTS:
+//   - every listening socket, so connections keep queueing in the kernel
+//     while the processes change hands and none is refused,
+//   - the live connections of the room, with what was read from them but
+//     not handled yet, along with the room saved as for a migration.
+// The new process acknowledges all of it before it serves anything. Until
+// then the old one keeps its listeners and sessions, and carries on if the
+// handover fails, the new process dying included; after it, the old process
+// stops accepting, and exits once it has drained.
+namespace upgrade {
+
+// A session that can move to the new process as it is: it has nothing left
+// to write and its framing keeps no state but the bytes read ahead.
+_EXPORT class Transferable {
+public:
+    struct Handoff {
+        int fd;
+        // "tcp4", "tcp6" or "unix"
+        std::string family;
+        std::string read_ahead;
+    };
+
+    virtual ~Transferable() = default;
+    // nothing queued or being written
+    virtual bool idle() const = 0;
+    // stop reading; true once the pending read has returned, until then it
+    // is called again
+    virtual bool pause() = 0;
+    // read again, the upgrade was called off
+    virtual void unpause() = 0;
+    // a duplicate of the socket for the new process, none if the session
+    // can't be transferred; it stays paused here until detach() or unpause()
+    virtual auto handoff() -> std::optional<Handoff> = 0;
+    // the new process took over, the session goes silent
+    virtual void detach() = 0;
+};
+
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+
+// Messages are a u32 length and JSON, with at most one descriptor attached.
+// The exchange happens once per deploy and is small, so it is done with
+// blocking calls.
+_EXPORT inline void send(int sock, const json& header, int fd = -1)
+{
+    auto text { header.dump(-1, ' ', false, json::error_handler_t::replace) };
+    std::string data(4, '\0');
+    for (int i = 0; i < 4; i++)
+        data[i] = static_cast<char>(text.size() >> (8 * i));
+    data += text;
+
+    iovec iov { data.data(), data.size() };
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+    if (fd >= 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        auto cmsg { CMSG_FIRSTHDR(&msg) };
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    // the descriptor goes with the first chunk
+    auto n { ::sendmsg(sock, &msg, MSG_NOSIGNAL) };
+    for (std::size_t sent = 0; n > 0 && (sent += n) < data.size();)
+        n = ::send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n < 0)
+        throw std::system_error(errno, std::generic_category(), "upgrade send");
+}
+
+// the header, and the descriptor that came with it or -1
+_EXPORT inline auto receive(int sock) -> std::pair<json, int>
+{
+    char prefix[4];
+    iovec iov { prefix, sizeof(prefix) };
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    auto n { ::recvmsg(sock, &msg, MSG_WAITALL) };
+    if (n != sizeof(prefix))
+        throw std::runtime_error("upgrade: connection closed");
+    int fd { -1 };
+    if (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+    std::uint32_t size {};
+    for (int i = 0; i < 4; i++)
+        size |= static_cast<std::uint32_t>(static_cast<unsigned char>(prefix[i])) << (8 * i);
+    std::string text(size, '\0');
+    if (size && ::recv(sock, text.data(), size, MSG_WAITALL) != static_cast<ssize_t>(size))
+        throw std::runtime_error("upgrade: connection closed");
+    return { json::parse(text), fd };
+}
+
+// what the new process gets from the old one
+_EXPORT struct Inheritance {
+    std::map<std::string, int> listeners;
+    std::string room;
+    struct Session {
+        std::string slot;
+        bool is_local;
+        Transferable::Handoff handoff;
+    };
+    std::vector<Session> sessions;
+    // input the room received while frozen, by slot
+    std::vector<std::pair<std::string, std::string>> inputs;
+};
+
+// Asks the server listening on `path` to hand everything over.
+_EXPORT inline auto take_over(const std::string& path) -> Inheritance
+{
+    auto sock { ::socket(AF_UNIX, SOCK_STREAM, 0) };
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        auto error { errno };
+        ::close(sock);
+        throw std::system_error(error, std::generic_category(), "upgrade: connect to " + path);
+    }
+    Inheritance res;
+    try {
+        for (;;) {
+            auto [header, fd] = receive(sock);
+            auto type { header["type"].get<std::string>() };
+            if (type == "listener")
+                res.listeners[header["name"]] = fd;
+            else if (type == "room")
+                res.room = header["snapshot"];
+            else if (type == "session")
+                res.sessions.push_back({ header["slot"], header["is_local"], { fd, header["family"], header["read_ahead"] } });
+            else if (type == "input")
+                res.inputs.emplace_back(header["slot"], header["message"]);
+            else if (type == "done") {
+                // from here on the old process lets go
+                send(sock, { { "type", "ack" } });
+                break;
+            }
+            else if (type == "abort")
+                throw std::runtime_error("upgrade: called off, " + header["reason"].get<std::string>());
+        }
+    } catch (...) {
+        ::close(sock);
+        throw;
+    }
+    ::close(sock);
+    logger->info("upgrade: took over {} listeners and {} sessions", res.listeners.size(), res.sessions.size());
+    return res;
+}
+
+#endif
+
+// The listening sockets of the server by name, opened here or inherited from
+// the process that was upgraded.
+_EXPORT class Listeners {
+public:
+    Listeners(asio::io_context& io_context, std::map<std::string, int> inherited = {})
+        : io_context_ { io_context }
+        , inherited_ { std::move(inherited) }
+    {
+    }
+    Listeners(const Listeners&) = delete;
+    ~Listeners()
+    {
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+        // inherited but no longer configured
+        for (auto [name, fd] : inherited_) {
+            logger->info("upgrade: {} is not served any more", name);
+            ::close(fd);
+        }
+#endif
+    }
+
+    // served on `io_context` if given, e.g. the HTTP API's
+    template <typename Acceptor>
+    auto open(const std::string& name, const typename Acceptor::endpoint_type& endpoint, asio::io_context* io_context = nullptr) -> Acceptor&
+    {
+        auto acceptor { std::make_shared<Acceptor>(io_context ? *io_context : io_context_) };
+        if (auto it = inherited_.find(name); it != inherited_.end()) {
+            acceptor->assign(endpoint.protocol(), it->second);
+            inherited_.erase(it);
+        } else {
+            if constexpr (std::is_same_v<typename Acceptor::protocol_type, tcp>)
+                acceptor->open(endpoint.protocol()), acceptor->set_option(asio::socket_base::reuse_address { true });
+            else
+                remove_stale_socket<typename Acceptor::protocol_type>(endpoint.path()), acceptor->open(endpoint.protocol());
+            acceptor->bind(endpoint);
+            acceptor->listen();
+        }
+        // closed on its own thread
+        entries_.push_back({ name, [acceptor] { return static_cast<int>(acceptor->native_handle()); }, [acceptor] {
+                                asio::dispatch(acceptor->get_executor(), [acceptor] {
+                                    asio::error_code ec;
+                                    acceptor->close(ec);
+                                });
+                            } });
+        return *acceptor;
+    }
+
+    auto handles() const
+    {
+        std::vector<std::pair<std::string, int>> res;
+        for (auto& entry : entries_)
+            res.emplace_back(entry.name, entry.native_handle());
+        return res;
+    }
+    // stop accepting; listeners whose sockets were handed over keep serving
+    // in the new process
+    void close()
+    {
+        for (auto& entry : entries_)
+            entry.close();
+    }
+
+private:
+    // A unix domain socket left behind by a server that is gone is removed.
+    // Anything else at `path`, a running server's socket included, is not
+    // ours to take.
+    template <typename Protocol>
+    void remove_stale_socket(const std::string& path)
+    {
+        auto status { std::filesystem::symlink_status(path) };
+        if (!std::filesystem::exists(status))
+            return;
+        if (!std::filesystem::is_socket(status))
+            throw std::runtime_error(path + " exists and is not a socket");
+        typename Protocol::socket probe { io_context_ };
+        asio::error_code ec;
+        probe.connect({ path }, ec);
+        if (!ec)
+            throw std::runtime_error(path + " is in use by a running server");
+        std::filesystem::remove(path);
+    }
+
+    struct Entry {
+        std::string name;
+        std::function<int()> native_handle;
+        std::function<void()> close;
+    };
+
+    asio::io_context& io_context_;
+    std::map<std::string, int> inherited_;
+    std::vector<Entry> entries_;
+};
+
+}
@@ -0,0 +1,355 @@
+#pragma once
+#ifndef _EXPORT
+#define _EXPORT
+#endif
+
+#include <asio/awaitable.hpp>
+#include <asio/buffer.hpp>
+#include <asio/read.hpp>
+#include <asio/read_until.hpp>
+#include <asio/use_awaitable.hpp>
+#include <asio/write.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <zlib.h>
+
+#include "rule.hpp"
+
+using asio::awaitable;
+using asio::use_awaitable;
+
+namespace websocket {
+
+inline auto sha1(std::string_view data) -> std::array<unsigned char, 20>
+{
+    std::uint32_t h[5] { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    auto rotl = [](std::uint32_t x, int n) { return x << n | x >> (32 - n); };
+
+    std::string msg { data };
+    auto bit_length = static_cast<std::uint64_t>(msg.size()) * 8;
+    msg.push_back(static_cast<char>(0x80));
+    while (msg.size() % 64 != 56)
+        msg.push_back(0);
+    for (int i = 7; i >= 0; i--)
+        msg.push_back(static_cast<char>(bit_length >> (i * 8)));
+
+    for (std::size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+        std::uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            auto p = reinterpret_cast<const unsigned char*>(&msg[chunk + i * 4]);
+            w[i] = p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 80; i++)
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        auto [a, b, c, d, e] = h;
+        for (int i = 0; i < 80; i++) {
+            auto [f, k] = i < 20 ? std::pair { (b & c) | (~b & d), 0x5a827999u }
+                : i < 40         ? std::pair { b ^ c ^ d, 0x6ed9eba1u }
+                : i < 60         ? std::pair { (b & c) | (b & d) | (c & d), 0x8f1bbcdcu }
+                                 : std::pair { b ^ c ^ d, 0xca62c1d6u };
+            auto temp = rotl(a, 5) + f + e + k + w[i];
+            e = d, d = c, c = rotl(b, 30), b = a, a = temp;
+        }
+        h[0] += a, h[1] += b, h[2] += c, h[3] += d, h[4] += e;
+    }
+
+    std::array<unsigned char, 20> digest;
+    for (int i = 0; i < 20; i++)
+        digest[i] = static_cast<unsigned char>(h[i / 4] >> (24 - i % 4 * 8));
+    return digest;
+}
+
+inline auto base64(std::string_view data) -> std::string
+{
+    constexpr std::string_view table { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" };
+    std::string res;
+    for (std::size_t i = 0; i < data.size(); i += 3) {
+        std::uint32_t n = static_cast<unsigned char>(data[i]) << 16;
+        if (i + 1 < data.size())
+            n |= static_cast<unsigned char>(data[i + 1]) << 8;
+        if (i + 2 < data.size())
+            n |= static_cast<unsigned char>(data[i + 2]);
+        res += table[n >> 18 & 63];
+        res += table[n >> 12 & 63];
+        res += i + 1 < data.size() ? table[n >> 6 & 63] : '=';
+        res += i + 2 < data.size() ? table[n & 63] : '=';
+    }
+    return res;
+}
+
+inline auto accept_key(std::string_view key)
+{
+    auto digest = sha1(std::string { key } + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+    return base64({ reinterpret_cast<const char*>(digest.data()), digest.size() });
+}
+
+enum class Opcode : unsigned char {
+    CONTINUATION = 0x0,
+    TEXT = 0x1,
+    BINARY = 0x2,
+    CLOSE = 0x8,
+    PING = 0x9,
+    PONG = 0xa,
+};
+
+class ClosedException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+}
+
+// Framing policy of BasicSession for browser clients: an HTTP upgrade
+// handshake, then every Message travels as one text frame. permessage-deflate
+// keeps its sliding window across messages, so consecutive UI snapshots
+// compress against each other.
+_EXPORT class WebSocketFraming {
+public:
+    WebSocketFraming() = default;
+    WebSocketFraming(const WebSocketFraming&) = delete;
+    ~WebSocketFraming()
+    {
+        if (deflate_enabled_) {
+            deflateEnd(&deflate_);
+            inflateEnd(&inflate_);
+        }
+    }
+
+    template <typename Socket>
+    awaitable<void> accept(Socket& socket)
+    {
+        auto n = co_await asio::async_read_until(socket, asio::dynamic_buffer(buffer_, max_header_size), "\r\n\r\n", use_awaitable);
+        std::string_view request { buffer_.data(), n };
+        std::string key, extensions, version;
+        bool upgrade {};
+        for (auto line : request | std::views::split(std::string_view { "\r\n" })) {
+            std::string_view sv { line.begin(), line.end() };
+            auto colon = sv.find(':');
+            if (colon == sv.npos)
+                continue;
+            auto name = sv.substr(0, colon) | std::views::transform([](char c) { return static_cast<char>(std::tolower(c)); }) | ranges::to<std::string>();
+            auto value = trim(sv.substr(colon + 1));
+            if (name == "upgrade")
+                upgrade = value.find("websocket") != value.npos || value.find("WebSocket") != value.npos;
+            else if (name == "sec-websocket-key")
+                key = value;
+            else if (name == "sec-websocket-extensions")
+                extensions = value;
+            else if (name == "sec-websocket-version")
+                version = value;
+        }
+        if (!upgrade || key.empty()) {
+            co_await asio::async_write(socket, asio::buffer(std::string_view { "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n" }), use_awaitable);
+            throw std::runtime_error("websocket: not an upgrade request");
+        }
+        // RFC 6455 4.4: name the version we speak
+        if (version != "13") {
+            co_await asio::async_write(socket, asio::buffer(std::string_view { "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nContent-Length: 0\r\n\r\n" }), use_awaitable);
+            throw std::runtime_error("websocket: unsupported version " + version);
+        }
+
+        std::string response { "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " + websocket::accept_key(key) + "\r\n" };
+        if (auto accepted = negotiate_deflate(extensions); !accepted.empty())
+            response += "Sec-WebSocket-Extensions: " + accepted + "\r\n";
+        response += "\r\n";
+        buffer_.erase(0, n);
+        co_await asio::async_write(socket, asio::buffer(response), use_awaitable);
+    }
+
+    // read the next text message, control frames are answered through `reply`
+    template <typename Socket>
+    awaitable<std::string> read(Socket& socket, auto&& reply)
+    {
+        std::string message;
+        bool compressed {};
+        for (;;) {
+            co_await fill(socket, 2);
+            auto head0 = static_cast<unsigned char>(buffer_[0]), head1 = static_cast<unsigned char>(buffer_[1]);
+            bool fin = head0 & 0x80, rsv1 = head0 & 0x40, masked = head1 & 0x80;
+            auto opcode = static_cast<websocket::Opcode>(head0 & 0x0f);
+            std::uint64_t length = head1 & 0x7f;
+            std::size_t offset = 2;
+            if (length >= 126) {
+                std::size_t bytes = length == 126 ? 2 : 8;
+                co_await fill(socket, offset + bytes);
+                length = 0;
+                for (std::size_t i = 0; i < bytes; i++)
+                    length = length << 8 | static_cast<unsigned char>(buffer_[offset + i]);
+                offset += bytes;
+            }
+            if (!masked)
+                throw std::runtime_error("websocket: unmasked client frame");
+            if (message.size() + length > max_message_size)
+                throw std::runtime_error("websocket: message too large");
+            co_await fill(socket, offset + 4 + length);
+            auto mask = buffer_.substr(offset, 4);
+            auto payload = buffer_.substr(offset + 4, length);
+            buffer_.erase(0, offset + 4 + length);
+            for (std::size_t i = 0; i < payload.size(); i++)
+                payload[i] ^= mask[i % 4];
+
+            switch (opcode) {
+            case websocket::Opcode::CLOSE:
+                reply(frame(websocket::Opcode::CLOSE, payload.substr(0, 2)));
+                throw websocket::ClosedException("websocket: closed by peer");
+            case websocket::Opcode::PING:
+                reply(frame(websocket::Opcode::PONG, payload));
+                continue;
+            case websocket::Opcode::PONG:
+                continue;
+            case websocket::Opcode::CONTINUATION:
+                message += payload;
+                break;
+            default:
+                compressed = rsv1 && deflate_enabled_;
+                message = std::move(payload);
+                break;
+            }
+            if (fin)
+                break;
+        }
+        co_return compressed ? inflate(message) : message;
+    }
+
+    // every browser tab is a session of its own, which leaves with the tab
+    static constexpr bool local_leaves_on_close { true };
+    // browsers show who is online from the start
+    static constexpr bool lobby_on_join { true };
+
+    auto encode(std::string_view text) -> std::string
+    {
+        if (deflate_enabled_ && text.size() >= min_deflate_size)
+            return frame(websocket::Opcode::TEXT, deflate(text), true);
+        return frame(websocket::Opcode::TEXT, text);
+    }
+
+private:
+    enum : std::size_t {
+        max_header_size = 8192,
+        max_message_size = 1 << 20,
+        min_deflate_size = 256,
+    };
+
+    static auto trim(std::string_view sv) -> std::string
+    {
+        while (!sv.empty() && std::isspace(static_cast<unsigned char>(sv.front())))
+            sv.remove_prefix(1);
+        while (!sv.empty() && std::isspace(static_cast<unsigned char>(sv.back())))
+            sv.remove_suffix(1);
+        return std::string { sv };
+    }
+
+    // accept the first permessage-deflate offer we can honour, returns the
+    // response parameters
+    auto negotiate_deflate(std::string_view extensions) -> std::string
+    {
+        for (auto offer : extensions | std::views::split(',')) {
+            std::string_view sv { offer.begin(), offer.end() };
+            if (trim(sv.substr(0, sv.find(';'))) != "permessage-deflate")
+                continue;
+            std::string accepted { "permessage-deflate" };
+            bool no_context_takeover {};
+            int window_bits = 15;
+            for (auto param : sv | std::views::split(';') | std::views::drop(1)) {
+                auto p = trim({ param.begin(), param.end() });
+                auto name = trim(p.substr(0, p.find('=')));
+                if (name == "server_no_context_takeover") {
+                    no_context_takeover = true;
+                    accepted += "; server_no_context_takeover";
+                } else if (name == "server_max_window_bits" && p.find('=') != p.npos) {
+                    window_bits = std::atoi(trim(p.substr(p.find('=') + 1)).c_str());
+                    accepted += "; server_max_window_bits=" + std::to_string(window_bits);
+                }
+            }
+            // raw deflate in zlib needs at least 9 bits, a smaller window
+            // cannot be promised (RFC 7692 5.1)
+            if (window_bits < 9 || window_bits > 15)
+                continue;
+            deflateInit2(&deflate_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -window_bits, 8, Z_DEFAULT_STRATEGY);
+            inflateInit2(&inflate_, -15);
+            deflate_enabled_ = true;
+            no_context_takeover_ = no_context_takeover;
+            return accepted;
+        }
+        return {};
+    }
+
+    template <typename Socket>
+    awaitable<void> fill(Socket& socket, std::size_t size)
+    {
+        while (buffer_.size() < size) {
+            auto n = buffer_.size();
+            buffer_.resize(std::max<std::size_t>(size, n + 4096));
+            auto read = co_await socket.async_read_some(asio::buffer(buffer_.data() + n, buffer_.size() - n), use_awaitable);
+            buffer_.resize(n + read);
+        }
+    }
+
+    static auto frame(websocket::Opcode opcode, std::string_view payload, bool compressed = false) -> std::string
+    {
+        std::string res;
+        res += static_cast<char>(0x80 | (compressed ? 0x40 : 0) | std::to_underlying(opcode));
+        if (payload.size() < 126) {
+            res += static_cast<char>(payload.size());
+        } else if (payload.size() <= 0xffff) {
+            res += static_cast<char>(126);
+            for (int i = 1; i >= 0; i--)
+                res += static_cast<char>(payload.size() >> (i * 8));
+        } else {
+            res += static_cast<char>(127);
+            for (int i = 7; i >= 0; i--)
+                res += static_cast<char>(static_cast<std::uint64_t>(payload.size()) >> (i * 8));
+        }
+        return res += payload;
+    }
+
+    auto deflate(std::string_view text) -> std::string
+    {
+        std::string out(deflateBound(&deflate_, text.size()) + 16, '\0');
+        deflate_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+        deflate_.avail_in = static_cast<uInt>(text.size());
+        deflate_.next_out = reinterpret_cast<Bytef*>(out.data());
+        deflate_.avail_out = static_cast<uInt>(out.size());
+        ::deflate(&deflate_, Z_SYNC_FLUSH);
+        out.resize(out.size() - deflate_.avail_out);
+        // drop the 00 00 ff ff tail of the sync flush (RFC 7692 7.2.1)
+        out.resize(out.size() - 4);
+        if (no_context_takeover_)
+            deflateReset(&deflate_);
+        return out;
+    }
+
+    auto inflate(std::string data) -> std::string
+    {
+        data += std::string_view { "\x00\x00\xff\xff", 4 };
+        inflate_.next_in = reinterpret_cast<Bytef*>(data.data());
+        inflate_.avail_in = static_cast<uInt>(data.size());
+        std::string out;
+        std::array<char, 4096> chunk;
+        do {
+            inflate_.next_out = reinterpret_cast<Bytef*>(chunk.data());
+            inflate_.avail_out = static_cast<uInt>(chunk.size());
+            auto ret = ::inflate(&inflate_, Z_SYNC_FLUSH);
+            if (ret != Z_OK && ret != Z_BUF_ERROR)
+                throw std::runtime_error("websocket: inflate failed");
+            out.append(chunk.data(), chunk.size() - inflate_.avail_out);
+            if (out.size() > max_message_size)
+                throw std::runtime_error("websocket: message too large");
+        } while (inflate_.avail_out == 0);
+        return out;
+    }
+
+    std::string buffer_;
+    bool deflate_enabled_ {};
+    bool no_context_takeover_ {};
+    z_stream deflate_ {};
+    z_stream inflate_ {};
+};
@@ -2,24 +2,117 @@ add_rules("mode.debug", "mode.release")
 
 add_requires("asio", "nlohmann_json","spdlog","gtest")
 add_requires("range-v3", "fmt")
+add_requires("zlib")
 set_languages("cxxlatest")
 -- set_optimize("aggressive")
 set_optimize("fastest")
 -- set_warnings("more", "error")
 
+option("mcts_profile")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Profile the phases of the MCTS loop")
+    add_defines("NOGO_MCTS_PROFILE")
+option_end()
+
+option("alloc_tracking")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Count heap allocations per opcode handler and subsystem")
+    add_defines("NOGO_ALLOC_TRACKING")
+option_end()
+
 target("nogo")
     set_kind("binary")
     add_packages("asio", "nlohmann_json","spdlog")
-    add_packages("range-v3")
+    add_packages("range-v3", "zlib")
+    add_options("mcts_profile", "alloc_tracking")
+    if has_config("alloc_tracking") then
+        add_files("alloc.cpp")
+    end
     add_files("nogo.cpp")
     if is_plat("windows") or is_plat("mingw") then
         add_files("res.rc")
     end
     set_basename("nogo-server")
 
+if not is_plat("windows", "mingw") then
+target("bot-worker")
+    set_kind("binary")
+    add_packages("nlohmann_json", "range-v3", "spdlog")
+    add_options("mcts_profile", "alloc_tracking")
+    if has_config("alloc_tracking") then
+        add_files("alloc.cpp")
+    end
+    add_files("botworker.cpp")
+    set_basename("nogo-bot-worker")
+end
+
+target("bench-room")
+    set_kind("binary")
+    set_default(false)
+    add_packages("asio", "nlohmann_json","spdlog")
+    add_packages("range-v3", "zlib")
+    add_options("mcts_profile", "alloc_tracking")
+    if has_config("alloc_tracking") then
+        add_files("alloc.cpp")
+    end
+    add_files("bench/room.cpp")
+    set_basename("nogo-bench-room")
+
+target("solve")
+    set_kind("binary")
+    set_default(false)
+    add_packages("nlohmann_json", "range-v3")
+    add_files("solve.cpp")
+    set_basename("nogo-solve")
+
+-- the server as a header-only library, for programs that embed it (Server
+-- in server.hpp) instead of talking to nogo-server over TCP
+target("libnogo")
+    set_kind("headeronly")
+    add_headerfiles("*.hpp")
+    add_includedirs(".", { public = true })
+    add_packages("asio", "nlohmann_json", "spdlog", { public = true })
+    add_packages("range-v3", "zlib", { public = true })
+
+target("bench-embed")
+    set_kind("binary")
+    set_default(false)
+    add_deps("libnogo")
+    add_options("alloc_tracking")
+    if has_config("alloc_tracking") then
+        add_files("alloc.cpp")
+    end
+    add_files("bench/embed.cpp")
+    set_basename("nogo-bench-embed")
+
+target("bench-accept")
+    set_kind("binary")
+    set_default(false)
+    add_packages("asio", "nlohmann_json","spdlog")
+    add_packages("range-v3", "zlib")
+    add_options("alloc_tracking")
+    if has_config("alloc_tracking") then
+        add_files("alloc.cpp")
+    end
+    add_files("bench/accept.cpp")
+    set_basename("nogo-bench-accept")
+
+target("differential")
+    set_kind("binary")
+    set_default(false)
+    add_packages("nlohmann_json", "range-v3")
+    add_files("bench/differential.cpp")
+    set_basename("nogo-differential")
+
 target("test")
     set_kind("binary")
-    add_packages("asio","spdlog","gtest")
-    add_packages("range-v3", "fmt")
-    add_files("test/test.cpp")
+    add_packages("asio", "nlohmann_json","spdlog","gtest")
+    add_packages("range-v3", "fmt", "zlib")
+    add_options("mcts_profile", "alloc_tracking")
+    if has_config("alloc_tracking") then
+        add_files("alloc.cpp")
+    end
+    add_files("test/test.cpp", "test/library.cpp")
     set_basename("nogo-test")